@@ -5,16 +5,43 @@
 		affect the Insert, Delete, and Search (Retrieve) functions, and require the inclusion of the 
 		queue ADT.
 
-		NOTE: some of these functions have gone through several changes in the process of development. The
-		latest version of Retrieve (Search/GetNextResult) makes much of the current overly-complex delete
-		function redundant, but in the interest of not introducing problems so close to delivery, I've left
-		the cumbersome (but functional) Delete function in place.
+		Nothing here locks. Functions that only read the tree (SearchFirst/SearchInto/SearchBatch, the
+		cursors, iterators, frozen snapshots, Traverse, PrintNested, SelectAt/RankOf) may run in several threads at
+		once as long as no thread is modifying the tree; the caller supplies that exclusion (the
+		application holds a reader-writer lock). The exceptions are Search/GetNextResult/
+		FlushSearch, which share the tree's searchResults queue, and CompareCount's counter.
+		A published tree (PublishTree) needs no lock at all on the reading side.
+
+		NOTE: some of these functions have gone through several changes in the process of development.
+		Insert and Delete no longer recurse: each follows (or rebuilds from the parent links) the path
+		from the root in a fixed-size stack of link addresses, and rebalances back up that path only
+		until the change in height has been absorbed.
 			-CreateTree - builds a tree with the default data members as well as:
 				-a pointer to a function for comparing the key the tree is sorted on
 				-a pointer to a default freeData function (in case the stored data has dynamically allocated members)
 				-a pointer to a default getNew function for inserting new data into the tree
 				-a QUEUE of search results
 				-an integer (boolean) flag to indicate whether the tree allows duplicate keys or not.
+				-a NODE_POOL from which all of the tree's TREE_NODEs are allocated
+
+			-SetIntKey
+				-tells the tree that every item holds an int key at a fixed offset which orders the
+					items the same way compare does, so searches, inserts and deletes compare the ints
+					directly instead of calling compare
+
+			-SetKeyPrefix
+				-gives the tree a function returning an order-preserving 64-bit prefix of an item's
+					key; each node caches its item's prefix, so most comparisons on a descent are
+					settled inside the node without loading the item (SetIntKey caches the int key
+					the same way)
+
+			-CompareCount
+				-number of key comparisons made by the tree (only counted when built with
+					AVL_COUNT_COMPARES defined)
+
+			-ShareNodePool
+				-attaches an empty tree to another tree's NODE_POOL so both trees allocate nodes from
+					the same chunks (e.g. two indexes over the same records)
 
 			-InsertNew
 				-creates a new item of the tree's default type and inserts it into the tree
@@ -24,26 +51,50 @@
 				-inserts provided data into the tree
 				-rebalances the tree as necessary
 
+			-BuildTreeSorted
+				-builds an empty tree from an array already sorted on the tree's key in O(n)
+				-the middle item of each range becomes the subtree root, so the tree is perfectly
+					balanced and no rotations are needed; balance factors are set directly
+
 			-Search/GetNextResult/FlushResults
 				-Clears out any lingering searchResults from previous searches
 				-These three functions replace the standard Retrieve function and deal with the difficulties
 					of searching for data in a tree that may have multiple matches
-				-If the tree doesn't allow duplicates, Search stores the first in the tree's searchResults queue and exits
-				-If the tree allows duplicates, when search finds a match, it searches the left subtree adding
-					any matches it finds to the searchResult queue, then adds the root to the queue, then
-					searches the right subtree adding any matches to the queue.
+				-Search locates the range of matching nodes with EqualRange and enqueues each of them,
+					in key order, in the tree's searchResults queue
 				-Returns the count of located items
 			-GetNextResult
 				-dequeues an item from the tree's searchResult queueu and returns it to the caller
 				-if underflow, returns 0
 			-FlushResults
 				-cleans any remaining searchResults out of a given tree's searchResults queue
+
+			-SearchFirst/SearchNext/SearchInto
+				-reentrant alternative to Search/GetNextResult that allocates nothing and leaves the
+					tree untouched, so several readers may search the same tree at once
+				-SearchFirst sets up a caller-owned TREE_CURSOR (normally a local variable) and
+					returns the first match in key order; SearchNext returns each further match
+				-SearchInto copies up to maxResults matches into a caller-provided array
+
+			-SearchBatch
+				-looks up many keys at once, returning the first match for each in a caller-provided
+					array. The keys descend the tree together, a level at a time, and each step
+					prefetches the child a key moves to, so the cache misses of one key's descent
+					overlap with the comparisons of the others
+
+			-LowerBound/UpperBound/EqualRange/CursorNext
+				-LowerBound positions a cursor on the first node not less than a key, UpperBound on
+					the first node greater than it; CursorNext then walks forward in key order
+				-EqualRange positions a cursor on the first node matching a key and bounds the walk
+					at the first node past the last match. Both ends are found with one O(log n)
+					descent each, comparing each node on the path once, and the walk itself makes
+					no comparisons, however many duplicates share the key.
 			
 			-Delete
 				-locates a node containing data matching a provided target value
 				-calls a confirmation function to determine if it is the correct node to delete
-				-deletes the node, or continues to search, first left subtree, then right subtree
-				-when a node is deleted, it's dataPtr is immediately returned back up the call stack to the original caller
+				-deletes the node, or continues with the next match in key order
+				-when a node is deleted, it's dataPtr is returned to the original caller
 				-if no confirmation function is provided, or if the tree does not allow duplicates, the first
 					located match is deleted automatically, and a pointer to its data returned
 				-if no matches are found, 0 is returned
@@ -51,9 +102,44 @@
 				-behaves similarly to delete, but on locating a match, it also compares the address against
 					the target data.
 				-if searchCriteria and address match, the node is deleted. Success is returned.
-				-if searchCriteria match, but address does not, search left subtree, then right subtree.
+				-if searchCriteria match, but address does not, try the next match in key order.
 				-if no matches found, return failure (0)
 
+			-IterBegin/IterLast/IterSeek/IterNext/IterPrev
+				-every node keeps a pointer to its parent, maintained by insert, delete and the
+					rotations, so a TREE_ITER can step to the in-order successor or predecessor in
+					O(1) amortized time without a stack or callback
+				-IterSeek positions the iterator on the first node not less than a key, so a listing
+					can be paused and later resumed from the last key shown
+
+			-FreezeTree/RefreezeTree/FrozenLowerBound/FrozenNext/FrozenAt/FrozenSearchInto
+				-FreezeTree copies the tree's data pointers and key prefixes into one array in
+					Eytzinger order (children of slot i at 2i and 2i + 1), a read-only snapshot
+					that lookup-heavy phases can search without chasing node pointers
+				-RefreezeTree brings a snapshot up to date after a batch of inserts and deletes
+				-for a tree with an int key the snapshot also keeps the bare keys in their own
+					Eytzinger array; FrozenFindInt searches it branchlessly and FrozenFindInts
+					looks up many keys at once (eight per AVX2 gather when built with AVX2)
+
+			-PublishTree/Republish/RetireData/ReaderEnter/ReaderExit/DestroyPublished
+				-lets readers search a tree without any lock while one writer modifies it. Readers
+					search the published snapshot; after a batch of changes the writer calls
+					Republish, which freezes the tree again and swaps the new snapshot in with one
+					atomic store. Nodes have parent pointers, so a changed path can't be copied
+					without copying the whole tree; the snapshot is that copy, made once per batch.
+				-each reader announces the epoch it entered in. A replaced snapshot, and data the
+					writer has taken out of the tree and handed to RetireData, is released once
+					every reader still inside entered after it was replaced; until then it waits
+					on the retired list. The most recently released snapshot is kept and refilled
+					by the next Republish.
+
+			-SelectAt/RankOf
+				-every node also records the size of its subtree, maintained by insert, delete and
+					the rotations, making the tree an order-statistic tree
+				-SelectAt returns the k-th smallest data (from 0); RankOf returns the number of
+					nodes less than a key. Both are O(log n), so a page of the tree or a percentile
+					can be located without counting through a traversal.
+
 			-Filter
 				-Traverse with the addition of an extra compare function that limits which items will be processed
 
@@ -69,26 +155,34 @@
 			-DestroyTree
 				-similar to the destroy function in the books AVL ADT implementation
 				-with the addition of first flushing the searchResults queue, then freeing the queue head
+				-nodes are not freed one at a time; the pool's chunks are released once the last tree
+					using the pool is destroyed. The tree is only walked if its data must be destroyed
+					or its nodes must be returned to a pool that is still shared.
 ************************************************************************************************************/
 
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <sched.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 #include "AVL_ADT.h"
 
-static int		_insert         (TREE_NODE **root, TREE_NODE *newPtr, int (*compare)(void *arg1, void *arg2),
-									int allowDup, int *taller);
+static int		_compare		(TREE *tree, void *arg1, void *arg2);
+static int		_compareNode	(TREE *tree, void *key, unsigned long long prefix, TREE_NODE *node);
+static unsigned long long	_prefix	(TREE *tree, void *dataPtr);
+static void		_refreshPrefixes(TREE *tree);
+
+static int		_insert         (TREE *tree, TREE_NODE *newPtr);
+
+static TREE_NODE	*_build			(TREE *tree, void **items, int n, int *height);
 
 static void		insLeftBal		(TREE_NODE **root, int *taller);
 static void		insRightBal		(TREE_NODE **root, int *taller);
 
-static void		*_delete        (TREE_NODE **root, void *dataPtr, int (*compare)(void *arg1, void *arg2),
-									void (*freeData)(void *arg1), int confirm(void *dataPtr),
-									enum destConst destroyData, int atAddress, int *shorter);
-
-static void		*_deleteDup        (TREE_NODE **root, void *dataPtr, int (*compare)(void *arg1, void *arg2),
-									void (*freeData)(void *arg1), int confirm(void *dataPtr),
-									enum destConst destroyData, int atAddress, int *shorter);
+static TREE_NODE	*_locate		(TREE *tree, void *dataPtr, int confirm(void *dataPtr), int atAddress);
+static void		*_delete        (TREE *tree, TREE_NODE *dltPtr, enum destConst destroyData);
 
 static void		dltRightBal		(TREE_NODE **root, int *shorter);
 static void		dltLeftBal		(TREE_NODE **root, int *shorter);
@@ -98,14 +192,21 @@ static void		rotateRight		(TREE_NODE **root);
 static void		rotateLeft		(TREE_NODE **root);
 
 
-static int		_retrieve		(TREE_NODE *root, void *target, TREE *tree);
+static int		_descendBound	(TREE *tree, void *key, TREE_CURSOR *cursor, int upper);
+static void		_pushLeft		(TREE_CURSOR *cursor, TREE_NODE *root);
 
-static int		_retrieveDup	(TREE_NODE *root, void *target, TREE *tree);
+static void		_freezeFill		(FROZEN_TREE *frozen, int pos, TREE_ITER *iter);
+static int		_compareSlot	(TREE *tree, void *key, unsigned long long prefix, FROZEN_SLOT *slot);
+static int		_frozenIntBound	(FROZEN_TREE *frozen, int key);
+static void		_reclaim		(PUBLISHED_TREE *pub);
+#ifdef __AVX2__
+static void		_frozenIntBound8(FROZEN_TREE *frozen, const int *keys, int *pos);
+#endif
 
 static void		_traverse       (TREE_NODE *root, void (*process)(void *dataPtr));
 
 
-static void		_printNested    (TREE_NODE *root, void (*print)(void *dataPtr), int showNums);
+static void		_printNested    (TREE_NODE *root, void (*print)(void *dataPtr), int showNums, int level);
 
 
 static int		_filter         (TREE_NODE *root, int (*compare)(void *arg1, void *arg2),
@@ -113,7 +214,26 @@ static int		_filter         (TREE_NODE *root, int (*compare)(void *arg1, void *a
 
 
 static void		_destroy        (TREE_NODE *root, enum destConst destroyData,
-									void (*freeData)(void *dataPtr));
+									void (*freeData)(void *dataPtr), NODE_POOL *pool);
+
+
+static NODE_POOL	*createPool		(void);
+static NODE_POOL	*releasePool	(NODE_POOL *pool);
+static TREE_NODE	*allocNode		(NODE_POOL *pool);
+static void			freeNode		(NODE_POOL *pool, TREE_NODE *node);
+
+#define POOL_FIRST_CHUNK	256
+#define POOL_MAX_CHUNK		65536
+
+#define SIZE_OF(node)		((node) ? (node)->size : 0)
+
+#define SEARCH_BATCH		8			//keys descending together in SearchBatch
+
+#ifdef __GNUC__
+#define PREFETCH(addr)		__builtin_prefetch(addr)
+#else
+#define PREFETCH(addr)
+#endif
 
 
 /****** CreateTree *******************************************************************
@@ -144,9 +264,21 @@ TREE *CreateTree(int (*compare)(void  *argu1, void *argu2),
   		tree->count = 0;
         tree->compare = compare;
         tree->allowDup = 1;
+		tree->intKeyOffset = -1;
+		tree->getPrefix = NULL;
+		tree->usePrefix = 0;
+#ifdef AVL_COUNT_COMPARES
+		tree->compares = 0;
+#endif
         tree->freeData = freeData;
         tree->getNew  = getNew;
 		tree->searchResults = createQueue();
+		tree->pool = createPool();
+		if (!tree->pool)  {
+			free(tree->searchResults);
+			free(tree);
+			return NULL;
+		}
     }//if
 
     return tree;
@@ -169,7 +301,15 @@ TREE *DestroyTree(TREE *tree, enum destConst destroyData)
     if(tree)  {
 		flushQueue(tree->searchResults);
 		free(tree->searchResults);
-        _destroy(tree->root, destroyData, tree->freeData);
+		if (tree->pool->refCount > 1)  {
+			//pool still in use by another tree -- hand the nodes back to it
+			_destroy(tree->root, destroyData, tree->freeData, tree->pool);
+		}
+		else if (destroyData)  {
+			//nodes go with the pool's chunks; only the data needs visiting
+			_destroy(tree->root, destroyData, tree->freeData, NULL);
+		}
+		tree->pool = releasePool(tree->pool);
 	}
 
     //All nodes deleted. Free structure
@@ -191,23 +331,26 @@ void  *InsertNew (TREE *tree)
     //Local Declarations
     void *dataPtr;
     TREE_NODE *newPtr;
-	int taller;
 
 //Statements
     dataPtr = tree->getNew();
-    newPtr = (TREE_NODE*) malloc(sizeof(TREE_NODE));
+    newPtr = allocNode(tree->pool);
     if(!newPtr)
         return 0;
 
     newPtr->right = NULL;
     newPtr->left = NULL;
     newPtr->dataPtr = dataPtr;
+	newPtr->prefix = _prefix(tree, dataPtr);
+	newPtr->size = 1;
+	newPtr->bal = EH;
 
-    if(_insert(&tree->root, newPtr, tree->compare, tree->allowDup, &taller))  {
+    if(_insert(tree, newPtr))  {
         (tree->count)++;
         return dataPtr;
     }
     else  {
+		freeNode(tree->pool, newPtr);
         return NULL;
     }
 }//BST_InsertNew
@@ -225,34 +368,81 @@ int Insert(TREE *tree, void *dataPtr)
 //Local Declarations
     TREE_NODE *newPtr;
 	int result = 0;
-	int taller;
 
 //Statements
-    newPtr = (TREE_NODE*) malloc(sizeof(TREE_NODE));
+    newPtr = allocNode(tree->pool);
     if(!newPtr)
         return 0;
 
     newPtr->right = NULL;
     newPtr->left = NULL;
     newPtr->dataPtr = dataPtr;
+	newPtr->prefix = _prefix(tree, dataPtr);
+	newPtr->size = 1;
 	newPtr->bal = EH;
 
     if(tree->count == 0)  {
         tree->root = newPtr;
+		newPtr->parent = NULL;
 		result = 1;
 	}
     else
-        result =  _insert(&tree->root, newPtr, tree->compare, tree->allowDup, &taller);
+        result =  _insert(tree, newPtr);
 
 	if(result)
 	{
 		(tree->count)++;
 	}
+	else
+	{
+		freeNode(tree->pool, newPtr);
+	}
 
     return result;
 }//BST_Insert
 
 
+/****** BuildTreeSorted ***************************************************************
+    Builds a balanced tree directly from an array of data sorted by the tree's compare
+	function. This replaces n calls to Insert (and their rotations) when loading a large
+	data set into an empty tree.
+        Pre     tree is pointer to an empty AVL tree structure
+				items is an array of n data pointers in ascending order; if the tree does
+					not allow duplicates no two items may compare equal
+        POST    tree built -or- tree unchanged
+        RETURN  success (1) -or- failure (0) if tree not empty, items out of order or
+					memory overflow
+***************************************************************************************/
+int BuildTreeSorted(TREE *tree, void **items, int n)
+{
+//Local Declarations
+	int i;
+	int height;
+	int result;
+
+//Statements
+	if (!tree || tree->count || n < 0)  {
+		return 0;
+	}
+	for (i = 1; i < n; i++)  {
+		result = _compare(tree, items[i - 1], items[i]);
+		if (result > 0 || (result == 0 && !tree->allowDup))  {
+			return 0;
+		}
+	}
+
+	if (n)  {
+		if (!(tree->root = _build(tree, items, n, &height)))  {
+			return 0;
+		}
+		tree->root->parent = NULL;
+	}
+	tree->count = n;
+
+	return 1;
+}//BuildTreeSorted
+
+
 /****** Search ************************************************************************
 	Search navigates a tree and locates all nodes matching the search criteria and
 	storing them in a queue for later retrieval by the GetNextResult function
@@ -263,14 +453,16 @@ int Insert(TREE *tree, void *dataPtr)
 ***************************************************************************************/
 int Search(TREE *tree, void *target)
 {
+//Local Declarations
+	TREE_CURSOR cursor;
+	void *dataPtr;
+
 //Statements
 	if(tree && tree->root)  {
 		flushQueue(tree->searchResults);
-		if (tree->allowDup)  {
-			_retrieveDup(tree->root, target, tree);
-		}
-		else  {
-			_retrieve(tree->root, target, tree);
+		EqualRange(tree, target, &cursor);
+		while ((dataPtr = CursorNext(&cursor)))  {
+			enqueue(tree->searchResults, dataPtr);
 		}
 	}
 
@@ -311,6 +503,906 @@ void FlushSearch(TREE *tree)
 }//FlushSearch
 
 
+/****** SearchFirst *******************************************************************
+	Starts a search for data matching target and returns the first match. Matches are
+	returned in key order, and no memory is allocated: all search state lives in the
+	caller's cursor.
+        PRE     tree has been created (may be null)
+                target is pointer to data structure containing the key to be located
+				cursor is pointer to a caller-owned TREE_CURSOR
+        POST    cursor positioned after the first match
+        RETURN  first matching data -or- NULL if none
+***************************************************************************************/
+void *SearchFirst(TREE *tree, void *target, TREE_CURSOR *cursor)
+{
+//Statements
+	EqualRange(tree, target, cursor);
+
+	return CursorNext(cursor);
+}//SearchFirst
+
+
+/****** SearchNext ********************************************************************
+	Returns the next match for a search started by SearchFirst.
+		PRE		cursor was set up by SearchFirst and the tree has not been modified since
+		POST	cursor advanced past the returned match
+		RETURN	next matching data -or- NULL when no more matches
+***************************************************************************************/
+void *SearchNext(TREE_CURSOR *cursor)
+{
+//Statements
+	return CursorNext(cursor);
+}//SearchNext
+
+
+/****** SearchInto ********************************************************************
+	Copies the data of up to maxResults nodes matching target into results, in key order.
+        PRE     tree has been created (may be null)
+                target is pointer to data structure containing the key to be located
+				results is an array of at least maxResults pointers
+        POST    results filled
+        RETURN  number of matches stored
+***************************************************************************************/
+int SearchInto(TREE *tree, void *target, void **results, int maxResults)
+{
+//Local Declarations
+	TREE_CURSOR cursor;
+	void *dataPtr;
+	int count = 0;
+
+//Statements
+	if (maxResults <= 0)  {
+		return 0;
+	}
+	for (dataPtr = SearchFirst(tree, target, &cursor); dataPtr; dataPtr = SearchNext(&cursor))  {
+		results[count++] = dataPtr;
+		if (count == maxResults)  {
+			break;
+		}
+	}
+
+	return count;
+}//SearchInto
+
+
+/****** SearchBatch *******************************************************************
+	Looks up n keys at once, as SearchFirst would one by one. SEARCH_BATCH keys descend
+	together: each round compares every key against its current node and prefetches the
+	child it moves to, which is then fetched while the other keys are being compared.
+	When the tree has no prefixes, each round also prefetches the data about to be
+	compared. Like SearchFirst, it leaves the tree untouched.
+        PRE     tree has been created (may be empty) -or- is NULL, which finds nothing
+				keys is an array of n pointers to data structures containing the keys
+				results has room for n pointers
+        POST    results[i] is the first match (in key order) for keys[i] -or- NULL
+        RETURN  number of keys found
+***************************************************************************************/
+int SearchBatch(TREE *tree, void **keys, void **results, int n)
+{
+//Local Declarations
+	TREE_NODE *node[SEARCH_BATCH];
+	unsigned long long prefix[SEARCH_BATCH];
+	int base;
+	int lane;
+	int lanes;
+	int active;
+	int cmp;
+	int found = 0;
+
+//Statements
+	if (!tree)  {
+		for (base = 0; base < n; base++)  {
+			results[base] = NULL;
+		}
+		return 0;
+	}
+	for (base = 0; base < n; base += SEARCH_BATCH)  {
+		lanes = (n - base < SEARCH_BATCH) ? n - base : SEARCH_BATCH;
+		for (lane = 0; lane < lanes; lane++)  {
+			node[lane] = tree->root;
+			prefix[lane] = _prefix(tree, keys[base + lane]);
+			results[base + lane] = NULL;
+		}
+		active = (tree->root != NULL);
+		while (active)  {
+			if (!tree->usePrefix)  {
+				for (lane = 0; lane < lanes; lane++)  {
+					if (node[lane])  {
+						PREFETCH(node[lane]->dataPtr);
+					}
+				}
+			}
+			active = 0;
+			for (lane = 0; lane < lanes; lane++)  {
+				if (!node[lane])  {
+					continue;
+				}
+				cmp = _compareNode(tree, keys[base + lane], prefix[lane], node[lane]);
+				if (cmp == 0)  {
+					results[base + lane] = node[lane]->dataPtr;
+				}
+				node[lane] = (cmp <= 0) ? node[lane]->left : node[lane]->right;
+				if (node[lane])  {
+					PREFETCH(node[lane]);
+					active = 1;
+				}
+			}
+		}
+		for (lane = 0; lane < lanes; lane++)  {
+			found += (results[base + lane] != NULL);
+		}
+	}
+
+	return found;
+}//SearchBatch
+
+
+/****** LowerBound ********************************************************************
+	Positions cursor on the first node whose data is not less than key. The cursor then
+	walks forward to the end of the tree.
+        PRE     tree has been created (may be null)
+                key is pointer to data structure containing the key to be located
+				cursor is pointer to a caller-owned TREE_CURSOR
+        POST    cursor positioned
+        RETURN  true (1) if positioned on a node -or- false (0) if every node is less than key
+***************************************************************************************/
+int LowerBound(TREE *tree, void *key, TREE_CURSOR *cursor)
+{
+//Statements
+	_descendBound(tree, key, cursor, 0);
+
+	return cursor->top != 0;
+}//LowerBound
+
+
+/****** UpperBound ********************************************************************
+	Positions cursor on the first node whose data is greater than key. The cursor then
+	walks forward to the end of the tree.
+        PRE     tree has been created (may be null)
+                key is pointer to data structure containing the key to be located
+				cursor is pointer to a caller-owned TREE_CURSOR
+        POST    cursor positioned
+        RETURN  true (1) if positioned on a node -or- false (0) if no node is greater than key
+***************************************************************************************/
+int UpperBound(TREE *tree, void *key, TREE_CURSOR *cursor)
+{
+//Statements
+	_descendBound(tree, key, cursor, 1);
+
+	return cursor->top != 0;
+}//UpperBound
+
+
+/****** EqualRange ********************************************************************
+	Positions cursor on the first node matching key and bounds it so that CursorNext stops
+	after the last match. For a tree without duplicates the end of the range is the
+	match's in-order successor, which is found without any further comparison; otherwise
+	it is located with a second (upper bound) descent.
+        PRE     tree has been created (may be null)
+                key is pointer to data structure containing the key to be located
+				cursor is pointer to a caller-owned TREE_CURSOR
+        POST    cursor positioned on the range of matches (empty if none)
+        RETURN  true (1) if at least one node matches -or- false (0)
+***************************************************************************************/
+int EqualRange(TREE *tree, void *key, TREE_CURSOR *cursor)
+{
+//Local Declarations
+	TREE_CURSOR upper;
+	TREE_NODE *match;
+
+//Statements
+	if (!_descendBound(tree, key, cursor, 0))  {
+		//lower bound missing or greater than key -- empty range
+		cursor->top = 0;
+		return 0;
+	}
+
+	if (tree->allowDup)  {
+		_descendBound(tree, key, &upper, 1);
+		cursor->end = upper.top ? upper.stack[upper.top - 1] : NULL;
+	}
+	else  {
+		match = cursor->stack[cursor->top - 1];
+		if (match->right)  {
+			for (match = match->right; match->left; match = match->left)
+				;
+			cursor->end = match;
+		}
+		else  {
+			cursor->end = (cursor->top > 1) ? cursor->stack[cursor->top - 2] : NULL;
+		}
+	}
+
+	return 1;
+}//EqualRange
+
+
+/****** CursorNext ********************************************************************
+	Returns the data at the cursor's position and advances it to the in-order successor.
+		PRE		cursor was positioned by LowerBound, UpperBound, EqualRange or SearchFirst
+					and the tree has not been modified since
+		POST	cursor advanced
+		RETURN	data -or- NULL when the walk reaches the end of its range
+***************************************************************************************/
+void *CursorNext(TREE_CURSOR *cursor)
+{
+//Local Declarations
+	TREE_NODE *current;
+
+//Statements
+	if (!cursor->top || cursor->stack[cursor->top - 1] == cursor->end)  {
+		return NULL;
+	}
+
+	current = cursor->stack[--(cursor->top)];
+	_pushLeft(cursor, current->right);
+
+	return current->dataPtr;
+}//CursorNext
+
+
+/****** IterBegin *********************************************************************
+	Positions an iterator on the first (smallest) node of the tree.
+        PRE     tree has been created (may be null)
+				iter is pointer to a caller-owned TREE_ITER
+        POST    iterator positioned
+        RETURN  first data -or- NULL if tree empty
+***************************************************************************************/
+void *IterBegin(TREE *tree, TREE_ITER *iter)
+{
+//Local Declarations
+	TREE_NODE *current = tree ? tree->root : NULL;
+
+//Statements
+	if (current)  {
+		while (current->left)  {
+			current = current->left;
+		}
+	}
+	iter->tree = tree;
+	iter->current = current;
+
+	return current ? current->dataPtr : NULL;
+}//IterBegin
+
+
+/****** IterLast **********************************************************************
+	Positions an iterator on the last (largest) node of the tree, for walking backward.
+        PRE     tree has been created (may be null)
+				iter is pointer to a caller-owned TREE_ITER
+        POST    iterator positioned
+        RETURN  last data -or- NULL if tree empty
+***************************************************************************************/
+void *IterLast(TREE *tree, TREE_ITER *iter)
+{
+//Local Declarations
+	TREE_NODE *current = tree ? tree->root : NULL;
+
+//Statements
+	if (current)  {
+		while (current->right)  {
+			current = current->right;
+		}
+	}
+	iter->tree = tree;
+	iter->current = current;
+
+	return current ? current->dataPtr : NULL;
+}//IterLast
+
+
+/****** IterSeek **********************************************************************
+	Positions an iterator on the first node whose data is not less than key, comparing
+	each node on the path once.
+        PRE     tree has been created (may be null)
+				key is pointer to data structure containing the key to seek
+				iter is pointer to a caller-owned TREE_ITER
+        POST    iterator positioned
+        RETURN  data at the new position -or- NULL if every node is less than key
+***************************************************************************************/
+void *IterSeek(TREE *tree, void *key, TREE_ITER *iter)
+{
+//Local Declarations
+	TREE_NODE *root = tree ? tree->root : NULL;
+	TREE_NODE *bound = NULL;
+	unsigned long long prefix = root ? _prefix(tree, key) : 0;
+
+//Statements
+	while (root)  {
+		if (_compareNode(tree, key, prefix, root) <= 0)  {
+			bound = root;
+			root = root->left;
+		}
+		else  {
+			root = root->right;
+		}
+	}
+	iter->tree = tree;
+	iter->current = bound;
+
+	return bound ? bound->dataPtr : NULL;
+}//IterSeek
+
+
+/****** IterNext **********************************************************************
+	Moves an iterator to the in-order successor: the leftmost node of the right subtree
+	if there is one, otherwise the first ancestor reached from its left side.
+		PRE		iter positioned by IterBegin/IterLast/IterSeek and tree not modified since
+		POST	iterator advanced
+		RETURN	data at the new position -or- NULL when past the last node
+***************************************************************************************/
+void *IterNext(TREE_ITER *iter)
+{
+//Local Declarations
+	TREE_NODE *current = iter->current;
+
+//Statements
+	if (!current)  {
+		return NULL;
+	}
+	if (current->right)  {
+		current = current->right;
+		while (current->left)  {
+			current = current->left;
+		}
+	}
+	else  {
+		while (current->parent && current == current->parent->right)  {
+			current = current->parent;
+		}
+		current = current->parent;
+	}
+	iter->current = current;
+
+	return current ? current->dataPtr : NULL;
+}//IterNext
+
+
+/****** IterPrev **********************************************************************
+	Moves an iterator to the in-order predecessor (mirror image of IterNext).
+		PRE		iter positioned by IterBegin/IterLast/IterSeek and tree not modified since
+		POST	iterator moved back
+		RETURN	data at the new position -or- NULL when before the first node
+***************************************************************************************/
+void *IterPrev(TREE_ITER *iter)
+{
+//Local Declarations
+	TREE_NODE *current = iter->current;
+
+//Statements
+	if (!current)  {
+		return NULL;
+	}
+	if (current->left)  {
+		current = current->left;
+		while (current->right)  {
+			current = current->right;
+		}
+	}
+	else  {
+		while (current->parent && current == current->parent->left)  {
+			current = current->parent;
+		}
+		current = current->parent;
+	}
+	iter->current = current;
+
+	return current ? current->dataPtr : NULL;
+}//IterPrev
+
+
+/****** SelectAt **********************************************************************
+	Returns the data with in-order position k (the k-th smallest, counting from 0), by
+	steering with the subtree sizes.
+        PRE     tree has been created (may be null)
+				k is the position sought
+        RETURN  data at position k -or- NULL if k is out of range
+***************************************************************************************/
+void *SelectAt(TREE *tree, int k)
+{
+//Local Declarations
+	TREE_NODE *root = tree ? tree->root : NULL;
+	int leftSize;
+
+//Statements
+	if (k < 0)  {
+		return NULL;
+	}
+	while (root)  {
+		leftSize = SIZE_OF(root->left);
+		if (k < leftSize)  {
+			root = root->left;
+		}
+		else if (k > leftSize)  {
+			k -= leftSize + 1;
+			root = root->right;
+		}
+		else  {
+			return root->dataPtr;
+		}
+	}
+
+	return NULL;
+}//SelectAt
+
+
+/****** RankOf ************************************************************************
+	Returns the number of nodes whose data is less than key, which is also the position
+	SelectAt would give the first match (or where key would be inserted).
+        PRE     tree has been created (may be null)
+				key is pointer to data structure containing the key to be ranked
+        RETURN  rank of key, 0 to TreeCount
+***************************************************************************************/
+int RankOf(TREE *tree, void *key)
+{
+//Local Declarations
+	TREE_NODE *root = tree ? tree->root : NULL;
+	unsigned long long prefix = root ? _prefix(tree, key) : 0;
+	int rank = 0;
+
+//Statements
+	while (root)  {
+		if (_compareNode(tree, key, prefix, root) <= 0)  {
+			root = root->left;
+		}
+		else  {
+			rank += SIZE_OF(root->left) + 1;
+			root = root->right;
+		}
+	}
+
+	return rank;
+}//RankOf
+
+
+/****** FreezeTree ********************************************************************
+	Takes a read-only snapshot of the tree: the data pointers, with their key prefixes, laid
+	out in one array in Eytzinger (breadth-first) order, so the children of slot i are slots
+	2i and 2i + 1 and a search walks down the array with no pointers to follow. The first
+	few levels of every search share the same few cache lines, and each step can prefetch
+	the slots it will need four levels further down.
+		The snapshot is not changed by later inserts or deletes; call RefreezeTree after a
+	batch of them. The data itself is shared with the tree, so a snapshot must not be
+	searched after its data has been destroyed.
+        PRE     tree has been created
+        POST    snapshot allocated
+        RETURN  pointer to snapshot -or- NULL if overflow
+***************************************************************************************/
+FROZEN_TREE *FreezeTree(TREE *tree)
+{
+//Local Declarations
+	FROZEN_TREE *frozen;
+
+//Statements
+	frozen = (FROZEN_TREE*) malloc(sizeof(FROZEN_TREE));
+	if (frozen)  {
+		frozen->tree = tree;
+		frozen->slots = NULL;
+		frozen->keys = NULL;
+		frozen->count = 0;
+		frozen->capacity = 0;
+		if (!RefreezeTree(frozen))  {
+			free(frozen);
+			return NULL;
+		}
+	}
+
+	return frozen;
+}//FreezeTree
+
+
+/****** RefreezeTree ******************************************************************
+	Rebuilds a snapshot from the current contents of its tree in O(n), reusing the slot
+	array when the tree has not outgrown it.
+        PRE     frozen was returned by FreezeTree and its tree still exists
+        POST    snapshot matches the tree -or- is unchanged if overflow
+        RETURN  success (1) -or- overflow (0)
+***************************************************************************************/
+int RefreezeTree(FROZEN_TREE *frozen)
+{
+//Local Declarations
+	FROZEN_SLOT *slots;
+	int *keys;
+	TREE_ITER iter;
+	int count = frozen->tree->count;
+
+//Statements
+	if (count > frozen->capacity)  {
+		slots = (FROZEN_SLOT*) realloc(frozen->slots, (count + 1) * sizeof(FROZEN_SLOT));
+		if (!slots)  {
+			return 0;
+		}
+		frozen->slots = slots;
+		if (frozen->keys)  {
+			keys = (int*) realloc(frozen->keys, (count + 1) * sizeof(int));
+			if (!keys)  {
+				return 0;
+			}
+			frozen->keys = keys;
+		}
+		frozen->capacity = count;
+	}
+	if (frozen->tree->intKeyOffset < 0)  {
+		free(frozen->keys);
+		frozen->keys = NULL;
+	}
+	else if (!frozen->keys)  {
+		if (!(frozen->keys = (int*) malloc((frozen->capacity + 1) * sizeof(int))))  {
+			return 0;
+		}
+	}
+	frozen->count = count;
+	IterBegin(frozen->tree, &iter);
+	_freezeFill(frozen, 1, &iter);
+
+	return 1;
+}//RefreezeTree
+
+
+/****** DestroyFrozenTree *************************************************************
+	Frees a snapshot. The tree and its data are not touched.
+        PRE     frozen was returned by FreezeTree (may be null)
+        RETURN  null pointer
+***************************************************************************************/
+FROZEN_TREE *DestroyFrozenTree(FROZEN_TREE *frozen)
+{
+//Statements
+	if (frozen)  {
+		free(frozen->slots);
+		free(frozen->keys);
+		free(frozen);
+	}
+
+	return NULL;
+}//DestroyFrozenTree
+
+
+/****** FrozenLowerBound **************************************************************
+	Finds the first item in the snapshot not less than key. The descent compares one slot
+	per level; the position of the last left turn is recovered from the bits of the final
+	index, so no stack is needed.
+        PRE     frozen is a valid snapshot
+				key is pointer to data structure containing the key to be located
+        RETURN  slot position of the bound (use FrozenAt/FrozenNext) -or- 0 if every item
+				is less than key
+***************************************************************************************/
+int FrozenLowerBound(FROZEN_TREE *frozen, void *key)
+{
+//Local Declarations
+	TREE *tree = frozen->tree;
+	unsigned long long prefix = _prefix(tree, key);
+	unsigned int i = 1;
+
+//Statements
+	while (i <= (unsigned int)frozen->count)  {
+		if (16 * i <= (unsigned int)frozen->count)  {
+			PREFETCH(frozen->slots + 16 * i);
+		}
+		i = 2 * i + (_compareSlot(tree, key, prefix, frozen->slots + i) > 0);
+	}
+	//undo the right turns taken after the last left turn, then that left turn
+	while (i & 1)  {
+		i >>= 1;
+	}
+
+	return (int)(i >> 1);
+}//FrozenLowerBound
+
+
+/****** FrozenNext ********************************************************************
+	Steps from a slot to the slot holding the next item in key order.
+        PRE     pos is a slot position from FrozenLowerBound or FrozenNext (not 0)
+        RETURN  next slot position -or- 0 after the last item
+***************************************************************************************/
+int FrozenNext(FROZEN_TREE *frozen, int pos)
+{
+//Statements
+	if (2 * pos + 1 <= frozen->count)  {
+		//leftmost slot of the right subtree
+		pos = 2 * pos + 1;
+		while (2 * pos <= frozen->count)  {
+			pos *= 2;
+		}
+		return pos;
+	}
+	//climb until arriving from a left child
+	while (pos & 1)  {
+		pos >>= 1;
+	}
+
+	return pos >> 1;
+}//FrozenNext
+
+
+/****** FrozenAt **********************************************************************
+        PRE     pos is a slot position from FrozenLowerBound or FrozenNext
+        RETURN  data stored at pos -or- NULL if pos is 0
+***************************************************************************************/
+void *FrozenAt(FROZEN_TREE *frozen, int pos)
+{
+//Statements
+	return pos ? frozen->slots[pos].dataPtr : NULL;
+}//FrozenAt
+
+
+/****** FrozenFindInt *****************************************************************
+	Looks up an int key in a snapshot of a tree with an int key (SetIntKey). The keys are
+	kept in their own Eytzinger-ordered array, sixteen to a cache line, and the descent is
+	branchless: every level costs one load and one comparison, whatever the outcome.
+        PRE     frozen is a snapshot of a tree with an int key
+        RETURN  first data (in key order) with the key -or- NULL if none
+***************************************************************************************/
+void *FrozenFindInt(FROZEN_TREE *frozen, int key)
+{
+//Local Declarations
+	int pos;
+
+//Statements
+	if (!frozen->keys)  {
+		return NULL;
+	}
+	pos = _frozenIntBound(frozen, key);
+
+	return (pos && frozen->keys[pos] == key) ? frozen->slots[pos].dataPtr : NULL;
+}//FrozenFindInt
+
+
+/****** FrozenFindInts ****************************************************************
+	Looks up n int keys at once, as FrozenFindInt would one by one. Built with AVX2
+	(__AVX2__ defined, e.g. -mavx2), eight keys descend the array together, one gather
+	per level; otherwise the keys are looked up one after another.
+        PRE     frozen is a snapshot of a tree with an int key
+				keys is an array of n keys; results has room for n pointers
+        POST    results[i] is the data for keys[i] -or- NULL if not found
+        RETURN  number of keys found
+***************************************************************************************/
+int FrozenFindInts(FROZEN_TREE *frozen, const int *keys, void **results, int n)
+{
+//Local Declarations
+	int i = 0;
+	int found = 0;
+#ifdef __AVX2__
+	int pos[8];
+	int lane;
+#endif
+
+//Statements
+	if (!frozen->keys)  {
+		for (i = 0; i < n; i++)  {
+			results[i] = NULL;
+		}
+		return 0;
+	}
+#ifdef __AVX2__
+	for ( ; i + 8 <= n; i += 8)  {
+		_frozenIntBound8(frozen, keys + i, pos);
+		for (lane = 0; lane < 8; lane++)  {
+			results[i + lane] = (pos[lane] && frozen->keys[pos[lane]] == keys[i + lane])
+									? frozen->slots[pos[lane]].dataPtr : NULL;
+		}
+	}
+#endif
+	for ( ; i < n; i++)  {
+		results[i] = FrozenFindInt(frozen, keys[i]);
+	}
+	for (i = 0; i < n; i++)  {
+		found += (results[i] != NULL);
+	}
+
+	return found;
+}//FrozenFindInts
+
+
+/****** FrozenSearchInto **************************************************************
+	Snapshot counterpart of SearchInto: copies the data of up to maxResults items matching
+	target into results, in key order.
+        PRE     frozen is a valid snapshot
+                target is pointer to data structure containing the key to be located
+				results is an array of at least maxResults pointers
+        POST    results filled
+        RETURN  number of matches stored
+***************************************************************************************/
+int FrozenSearchInto(FROZEN_TREE *frozen, void *target, void **results, int maxResults)
+{
+//Local Declarations
+	TREE *tree = frozen->tree;
+	unsigned long long prefix = _prefix(tree, target);
+	int pos;
+	int count = 0;
+
+//Statements
+	for (pos = FrozenLowerBound(frozen, target);
+		 pos && count < maxResults && !_compareSlot(tree, target, prefix, frozen->slots + pos);
+		 pos = FrozenNext(frozen, pos))  {
+		results[count++] = frozen->slots[pos].dataPtr;
+	}
+
+	return count;
+}//FrozenSearchInto
+
+
+/****** PublishTree *******************************************************************
+	Sets a tree up for lock-free reading by publishing a first snapshot of it.
+        PRE     tree has been created
+        POST    snapshot taken and published at epoch 1
+        RETURN  published tree -or- null if overflow
+***************************************************************************************/
+PUBLISHED_TREE *PublishTree(TREE *tree)
+{
+//Local Declarations
+	PUBLISHED_TREE *pub;
+	int i;
+
+//Statements
+	pub = (PUBLISHED_TREE*) malloc(sizeof(PUBLISHED_TREE));
+	if (pub)  {
+		if (!(pub->current = FreezeTree(tree)))  {
+			free(pub);
+			return NULL;
+		}
+		pub->spare = NULL;
+		pub->epoch = 1;
+		pub->retired = NULL;
+		for (i = 0; i < AVL_MAX_READERS; i++)  {
+			pub->readers[i].epoch = 0;
+		}
+	}
+
+	return pub;
+}//PublishTree
+
+
+/****** Republish *********************************************************************
+	Publishes a fresh snapshot of the tree in O(n) and retires the one it replaces. The new
+	snapshot is filled in before it is stored, so readers only ever see a complete one.
+	Releases whatever retired items no reader can still reach.
+        PRE     pub was returned by PublishTree; the caller is the only writer
+        POST    readers entering from now on see the tree as it is now
+        RETURN  success (1) -or- overflow (0), leaving the old snapshot published
+***************************************************************************************/
+int Republish(PUBLISHED_TREE *pub)
+{
+//Local Declarations
+	FROZEN_TREE *frozen = pub->spare;
+	RETIRED *old;
+
+//Statements
+	if (frozen)  {
+		if (!RefreezeTree(frozen))  {
+			return 0;
+		}
+	}
+	else if (!(frozen = FreezeTree(pub->current->tree)))  {
+		return 0;
+	}
+	old = (RETIRED*) malloc(sizeof(RETIRED));
+	if (!old)  {
+		pub->spare = frozen;
+		return 0;
+	}
+	pub->spare = NULL;
+	old->dataPtr = pub->current;
+	old->release = NULL;
+	old->epoch = pub->epoch;
+	old->next = pub->retired;
+	pub->retired = old;
+
+	//a reader that sees the new epoch is sure to see the new snapshot
+	__atomic_store_n(&pub->current, frozen, __ATOMIC_SEQ_CST);
+	__atomic_store_n(&pub->epoch, pub->epoch + 1, __ATOMIC_SEQ_CST);
+	_reclaim(pub);
+
+	return 1;
+}//Republish
+
+
+/****** RetireData ********************************************************************
+	Hands over data the writer has removed from the tree but which readers may still find
+	in the published snapshot. release is called on it once no reader can reach it, which
+	is no sooner than the next Republish.
+        PRE     pub was returned by PublishTree; the caller is the only writer
+				dataPtr is no longer in the tree
+        POST    dataPtr on the retired list
+        RETURN  success (1) -or- overflow (0): dataPtr was not retired and must not be freed
+***************************************************************************************/
+int RetireData(PUBLISHED_TREE *pub, void *dataPtr, void (*release)(void *dataPtr))
+{
+//Local Declarations
+	RETIRED *item;
+
+//Statements
+	item = (RETIRED*) malloc(sizeof(RETIRED));
+	if (!item)  {
+		return 0;
+	}
+	item->dataPtr = dataPtr;
+	item->release = release;
+	item->epoch = pub->epoch;
+	item->next = pub->retired;
+	pub->retired = item;
+
+	return 1;
+}//RetireData
+
+
+/****** ReaderEnter *******************************************************************
+	Starts a lock-free read: claims a reader slot, announces the current epoch in it and
+	returns the published snapshot, which stays valid until ReaderExit. Waits only if
+	AVL_MAX_READERS readers are already inside, giving up the processor after every pass
+	over the slots so the readers it waits for can finish.
+        PRE     pub was returned by PublishTree
+				slot is where to store the claimed slot number, for ReaderExit
+        RETURN  snapshot to search (FrozenLowerBound, FrozenSearchInto, ...)
+***************************************************************************************/
+FROZEN_TREE *ReaderEnter(PUBLISHED_TREE *pub, int *slot)
+{
+//Local Declarations
+	unsigned long epoch = __atomic_load_n(&pub->epoch, __ATOMIC_SEQ_CST);
+	unsigned long empty;
+	int i = 0;
+
+//Statements
+	for (;;)  {
+		empty = 0;
+		if (!__atomic_load_n(&pub->readers[i].epoch, __ATOMIC_RELAXED)
+			&& __atomic_compare_exchange_n(&pub->readers[i].epoch, &empty, epoch, 0,
+										   __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))  {
+			break;
+		}
+		if (++i == AVL_MAX_READERS)  {
+			i = 0;
+			sched_yield();
+		}
+	}
+	*slot = i;
+
+	return __atomic_load_n(&pub->current, __ATOMIC_SEQ_CST);
+}//ReaderEnter
+
+
+/****** ReaderExit ********************************************************************
+	Ends a read started by ReaderEnter; the snapshot it returned may be released after this.
+        PRE     slot was set by ReaderEnter
+        POST    slot free
+***************************************************************************************/
+void ReaderExit(PUBLISHED_TREE *pub, int slot)
+{
+//Statements
+	__atomic_store_n(&pub->readers[slot].epoch, 0, __ATOMIC_RELEASE);
+}//ReaderExit
+
+
+/****** DestroyPublished **************************************************************
+	Releases the snapshots and every retired item. The tree itself is not touched.
+        PRE     pub was returned by PublishTree (may be null); no reader is inside
+        RETURN  null pointer
+***************************************************************************************/
+PUBLISHED_TREE *DestroyPublished(PUBLISHED_TREE *pub)
+{
+//Local Declarations
+	RETIRED *item;
+
+//Statements
+	if (pub)  {
+		while ((item = pub->retired))  {
+			pub->retired = item->next;
+			if (item->release)  {
+				item->release(item->dataPtr);
+			}
+			else  {
+				DestroyFrozenTree((FROZEN_TREE*) item->dataPtr);
+			}
+			free(item);
+		}
+		DestroyFrozenTree(pub->current);
+		DestroyFrozenTree(pub->spare);
+		free(pub);
+	}
+
+	return NULL;
+}//DestroyPublished
+
+
 /****** Traverse **********************************************************************
     Process tree using inorder traversal.
         PRE     Tree has been created (may be null)
@@ -356,24 +1448,17 @@ int Filter  (TREE *tree,
 int Delete (TREE *tree, void *dltKey, int confirm(void *dataPtr), enum destConst destroy, void **dataOut)
 {
 //Local Declarations
-	int  shorter = 0;
+	TREE_NODE *dltPtr;
 
 //Statements
 	if(!tree || !tree->count)  {
 		*dataOut = NULL;
 		return 0;
 	}
-	if (tree->allowDup)  {
-		if((*dataOut = _deleteDup(&tree->root, dltKey, tree->compare, tree->freeData, confirm, destroy, 0, &shorter)))  {
-			(tree->count)--;
-			return 1;
-		}
-	}
-	else  {
-		if((*dataOut = _delete(&tree->root, dltKey, tree->compare, tree->freeData, confirm, destroy, 0, &shorter)))  {
-			(tree->count)--;
-			return 1;
-		}
+	if((dltPtr = _locate(tree, dltKey, confirm, 0)))  {
+		*dataOut = _delete(tree, dltPtr, destroy);
+		(tree->count)--;
+		return 1;
 	}
     
     *dataOut = NULL;
@@ -392,24 +1477,16 @@ int Delete (TREE *tree, void *dltKey, int confirm(void *dataPtr), enum destConst
 int DeleteAt (TREE *tree, void *dltKey, enum destConst destroy)
 {
 //Local Declarations
-   // void *dataPtr;    CHANGE
-	int  shorter = 0;
+	TREE_NODE *dltPtr;
 
 //Statements
 	if(!tree || !tree->count)  {
 		return 0;
 	}
-	if(tree->allowDup)  {
-		if((_deleteDup(&tree->root, dltKey, tree->compare, tree->freeData, NULL, destroy, 1, &shorter)))  {
-			(tree->count)--;
-			return 1;
-		}
-	}
-	else  {
-			if((_delete(&tree->root, dltKey, tree->compare, tree->freeData, NULL, destroy, 1, &shorter)))  {
-			(tree->count)--;
-			return 1;
-		}
+	if((dltPtr = _locate(tree, dltKey, NULL, 1)))  {
+		_delete(tree, dltPtr, destroy);
+		(tree->count)--;
+		return 1;
 	}
 
     return 0;
@@ -430,7 +1507,7 @@ int PrintNested (TREE *tree, void (*print)(void *dataPtr), int showNums)
     if(!tree || !tree->count)
         return 0;
 
-    _printNested(tree->root, print, showNums);
+    _printNested(tree->root, print, showNums, 1);
 
     return 1;
 }//PrintNested
@@ -471,121 +1548,338 @@ int FullTree (TREE *tree)
 }//FullTree
 
 
-/****** TreeCount ****************************************************************************
-    Returns number of nodes in tree.
-        PRE     tree has been created
-        RETURNS tree count
-**********************************************************************************************/
-int TreeCount (TREE *tree)
+/****** TreeCount ****************************************************************************
+    Returns number of nodes in tree.
+        PRE     tree has been created
+        RETURNS tree count
+**********************************************************************************************/
+int TreeCount (TREE *tree)
+{
+//Statements
+    return (tree->count);
+}//TreeCount
+
+
+/****** allowDup *************************************************************************
+    toggle the allowDuplicates option off or on for a tree
+        PRE     tree is a pointer to a valid tree
+        POST    tree->allowDup set to true (nonzero) or false(zero)
+******************************************************************************************/
+void allowDup(TREE *tree, int value)
+{
+//Statements
+    tree->allowDup = value;
+    return;
+}//allowDup
+
+
+/****** SetIntKey *************************************************************************
+    Declares that every item stored in the tree holds an int key offset bytes from its start,
+	and that ordering items by that int gives the same order as the tree's compare function.
+	Comparisons made while searching, inserting and deleting then read the two ints directly
+	rather than calling compare, and each node keeps a copy of its int as its key prefix, so
+	the descent only reaches into the item itself at an exact match. Pass a negative offset
+	to go back to calling compare.
+        PRE     tree is a pointer to a valid tree; search keys passed to the tree carry the
+				int key too
+        POST    tree->intKeyOffset set; prefixes of nodes already in the tree recomputed
+******************************************************************************************/
+void SetIntKey(TREE *tree, int offset)
+{
+//Statements
+	tree->intKeyOffset = offset;
+	_refreshPrefixes(tree);
+	return;
+}//SetIntKey
+
+
+/****** SetKeyPrefix **********************************************************************
+	Gives the tree a function that maps an item to a 64-bit prefix of its key, such that a
+	smaller prefix always means a smaller item under compare (for example the first eight
+	characters of a name, packed most significant first). The prefix is stored in each node;
+	nodes whose prefix differs from the search key's are ordered without calling compare or
+	touching the item, and compare is only called when the prefixes are equal. Pass NULL to
+	stop using prefixes. An int key set with SetIntKey takes precedence.
+        PRE     tree is a pointer to a valid tree
+        POST    tree->getPrefix set; prefixes of nodes already in the tree recomputed
+******************************************************************************************/
+void SetKeyPrefix(TREE *tree, unsigned long long (*getPrefix)(void *dataPtr))
+{
+//Statements
+	tree->getPrefix = getPrefix;
+	_refreshPrefixes(tree);
+	return;
+}//SetKeyPrefix
+
+
+/****** _prefix ***************************************************************************
+	Computes the key prefix stored in a node for dataPtr: the int key (biased so unsigned
+	order matches signed order) if the tree has one, else the tree's getPrefix result.
+        PRE     tree is a valid tree
+        RETURN  prefix -or- 0 if the tree uses no prefixes
+******************************************************************************************/
+static unsigned long long _prefix(TREE *tree, void *dataPtr)
+{
+//Statements
+	if (tree->intKeyOffset >= 0)  {
+		return (unsigned int)*(int *)((char *)dataPtr + tree->intKeyOffset) ^ 0x80000000u;
+	}
+	if (tree->getPrefix)  {
+		return tree->getPrefix(dataPtr);
+	}
+	return 0;
+}//_prefix
+
+
+/****** _refreshPrefixes *******************************************************************
+	Recomputes every node's prefix after the tree's key settings change.
+        PRE     tree is a valid tree
+        POST    tree->usePrefix and the prefix of every node updated
+******************************************************************************************/
+static void _refreshPrefixes(TREE *tree)
+{
+//Local Declarations
+	TREE_ITER iter;
+
+//Statements
+	tree->usePrefix = (tree->intKeyOffset >= 0 || tree->getPrefix);
+	for (IterBegin(tree, &iter); iter.current; IterNext(&iter))  {
+		iter.current->prefix = _prefix(tree, iter.current->dataPtr);
+	}
+	return;
+}//_refreshPrefixes
+
+
+/****** CompareCount ******************************************************************
+	Reports how many key comparisons the tree has made since it was created or the count
+	was last reset. Counting is compiled in only when AVL_COUNT_COMPARES is defined, so
+	normal builds pay nothing for it.
+        PRE     tree is a pointer to a valid tree
+				reset is true (nonzero) to zero the count after reading it
+        RETURN  comparisons made -or- 0 if counting is not compiled in
+******************************************************************************************/
+unsigned long CompareCount(TREE *tree, int reset)
+{
+//Local Declarations
+	unsigned long count = 0;
+
+//Statements
+#ifdef AVL_COUNT_COMPARES
+	count = tree->compares;
+	if (reset)  {
+		tree->compares = 0;
+	}
+#else
+	(void)tree;
+	(void)reset;
+#endif
+	return count;
+}//CompareCount
+
+
+/****** _compare ***********************************************************************
+    Compares two items the way the tree orders them. Every search, insert and delete
+	makes exactly one call per node on its path.
+        PRE     tree is a valid tree
+        RETURN  negative, zero or positive as compare would
+******************************************************************************************/
+static int _compare(TREE *tree, void *arg1, void *arg2)
+{
+//Local Declarations
+	int key1, key2;
+
+//Statements
+#ifdef AVL_COUNT_COMPARES
+	tree->compares++;
+#endif
+	if (tree->intKeyOffset < 0)  {
+		return tree->compare(arg1, arg2);
+	}
+	key1 = *(int *)((char *)arg1 + tree->intKeyOffset);
+	key2 = *(int *)((char *)arg2 + tree->intKeyOffset);
+	return (key1 > key2) - (key1 < key2);
+}//_compare
+
+
+/****** _compareNode ********************************************************************
+    Compares a search key, whose prefix has already been computed, with a node. When the
+	tree uses prefixes and the two differ, they decide the order without touching the
+	node's data; otherwise the data are compared as by _compare.
+        PRE     tree is a valid tree; prefix is _prefix(tree, key)
+        RETURN  negative, zero or positive as compare would
+******************************************************************************************/
+static int _compareNode(TREE *tree, void *key, unsigned long long prefix, TREE_NODE *node)
 {
 //Statements
-    return (tree->count);
-}//TreeCount
+	if (tree->usePrefix && prefix != node->prefix)  {
+#ifdef AVL_COUNT_COMPARES
+		tree->compares++;
+#endif
+		return (prefix < node->prefix) ? -1 : 1;
+	}
+	return _compare(tree, key, node->dataPtr);
+}//_compareNode
 
 
-/****** allowDup *************************************************************************
-    toggle the allowDuplicates option off or on for a tree
-        PRE     tree is a pointer to a valid tree
-        POST    tree->allowDup set to true (nonzero) or false(zero)
+/****** ShareNodePool ******************************************************************
+    Makes tree allocate its nodes from source's pool, so that several trees indexing the
+	same records share one set of chunks. The pool is released when the last tree using
+	it is destroyed.
+        PRE     tree and source are valid trees; tree is empty
+        POST    tree's own pool released; tree attached to source's pool
+		RETURN	success (1) -or- failure (0) if tree is not empty
 ******************************************************************************************/
-void allowDup(TREE *tree, int value)
+int ShareNodePool(TREE *tree, TREE *source)
 {
 //Statements
-    tree->allowDup = value;
-    return;
-}//allowDup
+	if (tree->count)  {
+		return 0;
+	}
+	if (tree->pool != source->pool)  {
+		releasePool(tree->pool);
+		tree->pool = source->pool;
+		(tree->pool->refCount)++;
+	}
+
+	return 1;
+}//ShareNodePool
 
 
 /****** _insert ***********************************************************************
-    This function uses recursion to insert the new data into a leaf node in the BST tree
-        PRE     Application has called BST_Insert, which passes root, data pointer,
-                    compare function, and value of "allowDuplicates" property (0 or nonzero).
-        POST    Data have been inserted
-        RETURN  pointer to [potentially] new root
+    This function inserts the new node as a leaf without recursion. The descent records
+	the address of each link it follows, and the direction taken, in a path stack whose
+	depth is bounded by AVL_MAX_HEIGHT. Every node on the path gains one in its subtree
+	size; balance factors are then fixed from the leaf upward, stopping as soon as a
+	subtree is found whose height did not change.
+        PRE     Application has called Insert or InsertNew, which pass the tree (for its
+					compare function and "allowDuplicates" property) and the new node
+        POST    Data have been inserted, or the tree is unchanged if the key is a refused
+					duplicate
+        RETURN  success (1) -or- duplicate refused (0)
 ***************************************************************************************/
-static int _insert(TREE_NODE **root, TREE_NODE *newPtr, int (*compare)(void *arg1, void *arg2),
-						int allowDup, int *taller)
+static int _insert(TREE *tree, TREE_NODE *newPtr)
 {
 //Local Declarations
-	int result;
+	TREE_NODE **path[AVL_MAX_HEIGHT];
+	int wentLeft[AVL_MAX_HEIGHT];
+	TREE_NODE **link = &tree->root;
+	TREE_NODE *parent = NULL;
+	int top = 0;
+	int taller = 1;
+	int cmp;
+	int i;
 
 //Statements
-    if(!*root) {
-        *root = newPtr;
-		*taller = 1;
-        return 1;
-    }
+	//Locate null subtree for insertion -- equal keys go right
+	while (*link)  {
+		cmp = _compareNode(tree, newPtr->dataPtr, newPtr->prefix, *link);
+		if (!cmp && !tree->allowDup)  {
+			//duplicate refused -- tree unchanged
+			return 0;
+		}
+		parent = *link;
+		path[top] = link;
+		wentLeft[top++] = cmp < 0;
+		link = (cmp < 0) ? &parent->left : &parent->right;
+	}
+	*link = newPtr;
+	newPtr->parent = parent;
+
+	for (i = 0; i < top; i++)  {
+		(*path[i])->size++;
+	}
 
-    //Locate null subtree for insertion
-	if (compare(newPtr->dataPtr, (*root)->dataPtr) < 0)  {
-		//newData < root -- go left
-        result = _insert(&(*root)->left, newPtr, compare, allowDup, taller);
-		if(*taller)  {
+	while (taller && top > 0)  {
+		link = path[--top];
+		if (wentLeft[top])  {
 			//left subtree is taller
-			switch((*root)->bal)
+			switch((*link)->bal)
 			{
 			case LH:	//was left high -- rotate
-						insLeftBal(root, taller); //insLeftBal determines single or double rotation
+						insLeftBal(link, &taller); //insLeftBal determines single or double rotation
 						break;
 			case EH:	//was EH -- now LH
-						(*root)->bal = LH;
+						(*link)->bal = LH;
 						break;
 			case RH:	//was RH -- now EH
-						(*root)->bal = EH;
-						*taller = 0;
+						(*link)->bal = EH;
+						taller = 0;
 						break;
 			}//switch
-			//return result;
-		}
-		return result;
-    }
-    else if (compare(newPtr->dataPtr, (*root)->dataPtr) > 0)  {
-		//newData > rootData
-        result = _insert(&(*root)->right, newPtr, compare, allowDup, taller);
-		if (*taller)  {
-		//	right subtree is taller
-			switch ((*root)->bal)
-			{
-			case LH:	//Was LH -- now EH
-						(*root)->bal = EH;
-						*taller = 0;
-						break;
-			case EH:	//Was balanced -- now RH
-						(*root)->bal = RH;
-						break;
-			case RH:	//Was RH -- now out of balance
-						insRightBal(root, taller);
-						break;
-			}
 		}
-		return result;
-    }
-    else if(allowDup)  {
-		//newData == root data AND duplicates allowed -- insert to the right
-        result = _insert(&(*root)->right, newPtr, compare, allowDup, taller);
-		if (*taller)  {
+		else  {
 			//right subtree is taller
-			switch ((*root)->bal)
+			switch ((*link)->bal)
 			{
 			case LH:	//Was LH -- now EH
-						(*root)->bal = EH;
-						*taller = 0;
+						(*link)->bal = EH;
+						taller = 0;
 						break;
 			case EH:	//Was balanced -- now RH
-						(*root)->bal = RH;
+						(*link)->bal = RH;
 						break;
 			case RH:	//Was RH -- now out of balance
-						insRightBal(root, taller);
+						insRightBal(link, &taller);
 						break;
-			}	
-			return result;
+			}//switch
 		}
-		return result;
-    }
-   return 0;
+	}
+
+	return 1;
 }//_insert
 
 
+/****** _build ************************************************************************
+    Recursively builds a subtree from a sorted range. The middle item becomes the root,
+	so the left range is never smaller than the right, and the two heights differ by at
+	most one.
+        PRE     items is an array of n > 0 sorted data pointers
+				tree is the tree being built (for its pool and key prefixes)
+        POST    height set to height of built subtree
+        RETURN  root of subtree -or- NULL if overflow (any nodes already taken are returned
+					to the pool)
+***************************************************************************************/
+static TREE_NODE *_build(TREE *tree, void **items, int n, int *height)
+{
+//Local Declarations
+	TREE_NODE *root;
+	int mid = n / 2;
+	int leftHeight = 0;
+	int rightHeight = 0;
+
+//Statements
+	if (!(root = allocNode(tree->pool)))  {
+		return NULL;
+	}
+	root->dataPtr = items[mid];
+	root->prefix = _prefix(tree, items[mid]);
+	root->left = NULL;
+	root->right = NULL;
+
+	if (mid > 0 && !(root->left = _build(tree, items, mid, &leftHeight)))  {
+		freeNode(tree->pool, root);
+		return NULL;
+	}
+	if (n - mid - 1 > 0 && !(root->right = _build(tree, items + mid + 1, n - mid - 1, &rightHeight)))  {
+		_destroy(root->left, PRESERVE, NULL, tree->pool);
+		freeNode(tree->pool, root);
+		return NULL;
+	}
+
+	if (root->left)  {
+		root->left->parent = root;
+	}
+	if (root->right)  {
+		root->right->parent = root;
+	}
+	root->size = n;
+	root->bal = (leftHeight > rightHeight) ? LH : EH;
+	*height = leftHeight + 1;
+
+	return root;
+}//_build
+
+
 /****** insLeftBal *******************************************************************
 	Tree out-of-balance on the left. This function rotates the tree to the right.
 		PRE		The tree is left high
@@ -692,306 +1986,147 @@ static void insRightBal(TREE_NODE **root, int *taller)
 }//insertRightBal
 
 
-/****** _delete ***************************************************************************
-    FUNCTION SPECIFIC TO DUPLICATE-REFUSING AVL TREES
-	Function locates a node matching the requested criteria. If node matching requested
-	criteria not found, return NULL. If atAddress is true, compare the addresses of target
-	data and root. If atAddress is NOT true, prompt the user for confirmation. If atAddress
-	is false, or the user refuses confirmation, return NULL. If confirm function pointer
-	is NULL, delete first located node without confirmation. AFTER DELETING NODE - if
-	destroy = DESTROY(0) destroy the stored data using freeData. If	destroy = PRESERVE(1),
-	do not destroy data. Return the address of the deleted data, regardless
-	of whether the node was deleted or not. The public function Delete will prevent the
-	freed data from being passed to the calling application.
+/****** _locate ***************************************************************************
+	Function locates the node to delete. The first node (in key order) matching the key is
+	found with a single descent, comparing each node once. If atAddress is true, the node
+	must also hold the address dataPtr; otherwise, if confirm is not NULL, the node must be
+	confirmed by it. A node that fails either test is passed over for the next match in
+	key order. A tree that refuses duplicates holds at most one match.
         PRE     tree initialized -- null tree OK
                 dataPtr contains key of node to be deleted
-				compare is pointer to compare function used to navigate the tree
-				freeData is pointer to type-specific function to free memory --
-					if application data does not have external dynamically allocated members
-					the standard function free() will suffice.
-				confirm is a pointer to function to confirm deletion. If NULL, function will
-					delete the first located matching data
-				destConst is an enumeration with possible values DESTROY and PRESERVE
+				confirm is a pointer to function to confirm deletion. If NULL, the first
+					located match is taken
 				atAddress is an integer (or boolean) flag to indicate whether the data to be
 					deleted resides at a specific address, or is based only on search criteria
-        POST    node is deleted and its space recycled -or- if key not found, tree is 
-                unchanged
-                success is true if deleted, false if not
-        RETURN  pointer to root
+        RETURN  node to delete -or- NULL if there is none
 *******************************************************************************************/
-static void* _delete(TREE_NODE **root, void *dataPtr, int (*compare)(void *arg1, void *arg2),
-                        void (*freeData)(void *arg1), int confirm(void *dataPtr),
-						enum destConst destroy, int atAddress, int *shorter)
+static TREE_NODE *_locate(TREE *tree, void *dataPtr, int confirm(void *dataPtr), int atAddress)
 {
 //Local Declarations
-    TREE_NODE *dltPtr;
-    TREE_NODE *exchPtr;
-    void* holdPtr;
-	void *result = NULL;
+	TREE_NODE *root = tree->root;
+	TREE_NODE *match = NULL;
+	TREE_ITER iter;
+	unsigned long long prefix = _prefix(tree, dataPtr);
+	int cmp;
 
 //Statements
-    if(!*root)
-    {
-		*shorter = 0;
-        return NULL;
-    }//if
-
-    if (compare (dataPtr, (*root)->dataPtr) < 0) {
-        result = _delete(&(*root)->left, dataPtr, compare, freeData, confirm, destroy, atAddress, shorter);
-		if (*shorter)  {
-			dltRightBal(root, shorter);
+	while (root)  {
+		cmp = _compareNode(tree, dataPtr, prefix, root);
+		if (cmp <= 0)  {
+			if (!cmp)  {
+				match = root;
+			}
+			root = root->left;
 		}
-		return result;
-	}
-    else if (compare(dataPtr, (*root)->dataPtr) > 0)  {
-        result = _delete(&(*root)->right, dataPtr, compare, freeData, confirm, destroy, atAddress, shorter);
-		if(*shorter)  {
-			dltLeftBal(root, shorter);
+		else  {
+			root = root->right;
 		}
-		return result;
 	}
-    else
-        //Node matching search criteria found
 
-		//if address-specific search and address doesn't match...
-        if(atAddress && (*root)->dataPtr != dataPtr)  { 
-				//tree disallows duplicate keys -- target not in tree
-				*shorter = 0;
-				return 0;
-        }
-		//if searching by criteria only AND a confirmation function exists...
-		if (confirm && !confirm((*root)->dataPtr))  { 
-			// ...and current data is disconfirmed as the correct data to delete...
-			// ...return failure -- tree disallows duplicate keys
-			*shorter = 0;
-			return 0;
+	iter.tree = tree;
+	iter.current = match;
+	while (match)  {
+		if (atAddress ? match->dataPtr == dataPtr : (!confirm || confirm(match->dataPtr)))  {
+			return match;
 		}
-		// In all other cases, the data matches, and is confirmed as the correct
-		// data to delete, or no confirmation is necessary...
-		// ...proceed with delete
-
-
-        // test for leaf node
-        dltPtr = *root;
-    if (!(*root)->left)
-    //No left subtree
-    {
-        *root = (*root)->right;
-		*shorter = 1;
-        if(destroy)  {
-            freeData(dltPtr->dataPtr);
-            holdPtr = dltPtr->dataPtr;
-        }
-        else  {
-            holdPtr = dltPtr->dataPtr;
-        }
-        free(dltPtr);
-        return holdPtr;
-    }
-    else
-        if (!(*root)->right)
-        //Only left subtree
-        {
-            *root = (*root)->left;
-			*shorter = 1;
-            if(destroy)  {
-                freeData(dltPtr->dataPtr);
-                holdPtr = dltPtr->dataPtr;
-            }
-            else  {
-                holdPtr = dltPtr->dataPtr;
-            }
-            free(dltPtr);
-            return holdPtr;
-        }
-        else
-        //delete node has two subtrees
-        {
-            exchPtr = (*root)->left;
-            //Find largest node on left subtree
-            while(exchPtr->right)
-                exchPtr = exchPtr->right;
-
-            //Exchange data
-            holdPtr = (*root)->dataPtr;
-            (*root)->dataPtr = exchPtr->dataPtr;
-            exchPtr->dataPtr = holdPtr;
-            result = _delete(&(*root)->left, exchPtr->dataPtr, compare, freeData, confirm, destroy, atAddress, shorter);
-			if(*shorter)  {
-				dltRightBal(root, shorter);
-			}
-			return result;
-        }//else
+		if (!tree->allowDup || !IterNext(&iter) || _compareNode(tree, dataPtr, prefix, iter.current))  {
+			return NULL;
+		}
+		match = iter.current;
+	}
 
-}//_delete
+	return NULL;
+}//_locate
 
 
-/****** _deleteDup ************************************************************************
-    FUNCTION SPECIFIC TO DUPLICATE-ALLOWING AVL TREES
-	Function locates a node matching the requested criteria. If node matching requested
-	criteria not found, return NULL. If atAddress is true, compare the addresses of target
-	data and root. If atAddress is NOT true, prompt the user for confirmation. If atAddress
-	is false, or the user refuses confirmation, recursively search left subtree, then right
-	subtree for more matching data. If confirm function pointer is NULL, delete first
-	located node without confirmation. AFTER DELETING NODE - if destroy = DESTROY(0) destroy
-	the stored data using freeData. If	destroy = PRESERVE(1), do not destroy data. Return
-	the address of the deleted data, regardless of whether the node was deleted or not. The
-	public function Delete will prevent the freed data from being passed to the calling
-	application.
-        PRE     tree initialized -- null tree OK
-                dataPtr contains key of node to be deleted
-				compare is pointer to compare function used to navigate the tree
-				freeData is pointer to type-specific function to free memory --
-					if application data does not have external dynamically allocated members
-					the standard function free() will suffice.
-				confirm is a pointer to function to confirm deletion. If NULL, function will
-					delete the first located matching data
+/****** _delete ***************************************************************************
+	Function removes a located node without recursion. A node with two subtrees first
+	exchanges data with the largest node of its left subtree, which is then removed in its
+	place. The path from the root to the removed node is rebuilt from the parent links
+	into a stack of link addresses; every node on it loses one from its subtree size, and
+	balance is restored from the bottom up, stopping as soon as a subtree is found whose
+	height did not change. AFTER DELETING NODE - if destroy = DESTROY(1) destroy the stored
+	data using freeData. If destroy = PRESERVE(0), do not destroy data. Return the address
+	of the deleted data, regardless of whether it was destroyed. The public function Delete
+	will prevent freed data from being passed to the calling application.
+        PRE     tree initialized; supplies the type-specific freeData function (if
+					application data does not have external dynamically allocated members
+					the standard function free() will suffice) and the pool the node is
+					returned to
+                dltPtr is a node of the tree (from _locate)
 				destConst is an enumeration with possible values DESTROY and PRESERVE
-				atAddress is an integer (or boolean) flag to indicate whether the data to be
-					deleted resides at a specific address, or is based only on search criteria
-        POST    node is deleted and its space recycled -or- if key not found, tree is 
-                unchanged
-                success is true if deleted, false if not
-        RETURN  pointer to root
-****************************************************************************************/
-static void* _deleteDup(TREE_NODE **root, void *dataPtr, int (*compare)(void *arg1, void *arg2),
-                        void (*freeData)(void *arg1), int confirm(void *dataPtr),
-						enum destConst destroy, int atAddress, int *shorter)
+        POST    node is deleted and its space recycled
+        RETURN  pointer to the deleted data
+*******************************************************************************************/
+static void *_delete(TREE *tree, TREE_NODE *dltPtr, enum destConst destroy)
 {
 //Local Declarations
-    TREE_NODE *dltPtr;
-    TREE_NODE *exchPtr;
-    void* holdPtr;
-	void *result = NULL;
+	TREE_NODE **path[AVL_MAX_HEIGHT];
+	int wentLeft[AVL_MAX_HEIGHT];
+	TREE_NODE *nodes[AVL_MAX_HEIGHT];
+	TREE_NODE *exchPtr;
+	TREE_NODE *child;
+	TREE_NODE *parent;
+	TREE_NODE **link;
+	void *holdPtr = dltPtr->dataPtr;
+	unsigned long long holdPrefix = dltPtr->prefix;
+	int depth = 0;
+	int shorter = 1;
+	int top;
 
 //Statements
-    if(!*root)
-    {
-		*shorter = 0;
-        return NULL;
-    }//if
-
-    if (compare (dataPtr, (*root)->dataPtr) < 0) {
-        result = _deleteDup(&(*root)->left, dataPtr, compare, freeData, confirm, destroy, atAddress, shorter);
-		if (*shorter)  {
-			dltRightBal(root, shorter);
+	if (dltPtr->left && dltPtr->right)  {
+		//delete node has two subtrees -- find largest node on left subtree
+		exchPtr = dltPtr->left;
+		while (exchPtr->right)  {
+			exchPtr = exchPtr->right;
 		}
-		return result;
+		//Exchange data; exchPtr has no right subtree
+		dltPtr->dataPtr = exchPtr->dataPtr;
+		dltPtr->prefix = exchPtr->prefix;
+		exchPtr->dataPtr = holdPtr;
+		exchPtr->prefix = holdPrefix;
+		dltPtr = exchPtr;
 	}
-    else if (compare(dataPtr, (*root)->dataPtr) > 0)  {
-        result = _deleteDup(&(*root)->right, dataPtr, compare, freeData, confirm, destroy, atAddress, shorter);
-		if(*shorter)  {
-			dltLeftBal(root, shorter);
-		}
-		return result;
+
+	//rebuild the path from the root down to the node being removed
+	for (parent = dltPtr->parent; parent; parent = parent->parent)  {
+		nodes[depth++] = parent;
+	}
+	link = &tree->root;
+	for (top = 0; top < depth; top++)  {
+		parent = nodes[depth - 1 - top];
+		child = (top + 1 < depth) ? nodes[depth - 2 - top] : dltPtr;
+		path[top] = link;
+		wentLeft[top] = (child == parent->left);
+		link = wentLeft[top] ? &parent->left : &parent->right;
+		parent->size--;
 	}
-    else
-        //Node matching search criteria found
-
-		//if address-specific search...
-        if(atAddress)  { //NOTE: else should only function on !atAddress, not on atAddress && matched addresses
-			if ((*root)->dataPtr != dataPtr)  { // ...and unmatching address
-				if ((result = _deleteDup(&(*root)->left, dataPtr, compare, freeData, confirm, destroy, atAddress, shorter)))  {
-					if (*shorter)  {
-					// ...if found and deleted on the left, rebalance the tree if necessary
-						dltRightBal(root, shorter);
-					}
-				}
-				// ...if not found on the left, check on the right...
-				else if ((result = _deleteDup(&(*root)->right, dataPtr, compare, freeData, confirm, destroy, atAddress, shorter)))  {
-					if (*shorter)  {
-						dltLeftBal(root, shorter);
-					}
-				}
-				return result;
-			}
-            //... if addresses match, allow deletion to take place farther down the code
-        }
-		//else if searching by criteria only AND a confirmation function exists...
-		else if (confirm && !confirm((*root)->dataPtr))  { 
-			// ...and current data is disconfirmed as the correct data to delete...
-			// ...first look on the left side...
-			
-			if ((result = _deleteDup(&(*root)->left, dataPtr, compare, freeData, confirm, destroy, atAddress, shorter)))  {
-				// ...if found and deleted on the left, rebalance the tree if necessary
-				if (*shorter)  {
-					dltRightBal(root, shorter);
-				}
-				//...and return the result
-				return result;
-			}
-			// ...if not found on the left, check on the right...
-			else if ((result = _deleteDup(&(*root)->right, dataPtr, compare, freeData, confirm, destroy, atAddress, shorter)))  {
-				if(*shorter)  {
-					dltLeftBal(root, shorter);
-				}
-				// ...and return the result
-				return result;
-			}
-			else  {				//DISCONFIRMED BASE CASE
-				// ...otherwise, data does not exist in the left subree or the right subtree and the root has been
-				//disconfirmed as the appropriate node to delete, return failure. 
-				return NULL;
-			}
-		}
-		// In all other cases, the data matches, and is confirmed as the correct
-		// data to delete, or no confirmation is necessary...
-		// ...proceed with delete
 
+	//splice out the node (link now addresses it) -- it has at most one subtree
+	child = dltPtr->left ? dltPtr->left : dltPtr->right;
+	*link = child;
+	if (child)  {
+		child->parent = dltPtr->parent;
+	}
 
-        // test for leaf node
-        dltPtr = *root;
-    if (!(*root)->left)
-    //No left subtree
-    {
-        *root = (*root)->right;
-		*shorter = 1;
-        if(destroy)  {
-            freeData(dltPtr->dataPtr);
-            holdPtr = dltPtr->dataPtr;
-        }
-        else  {
-            holdPtr = dltPtr->dataPtr;
-        }
-        free(dltPtr);
-        return holdPtr;  //SUCCESSFUL DELETE BASE CASE
-    }
-    else
-        if (!(*root)->right)
-        //Only left subtree
-        {
-            *root = (*root)->left;
-			*shorter = 1;
-            if(destroy)  {
-                freeData(dltPtr->dataPtr);
-                holdPtr = dltPtr->dataPtr;
-            }
-            else  {
-                holdPtr = dltPtr->dataPtr;
-            }
-            free(dltPtr);
-            return holdPtr;  //SUCCESSFUL DELETE BASE CASE
-        }
-        else
-        //delete node has two subtrees
-        {
-            exchPtr = (*root)->left;
-            //Find largest node on left subtree
-            while(exchPtr->right)
-                exchPtr = exchPtr->right;
-
-            //Exchange data
-            holdPtr = (*root)->dataPtr;
-            (*root)->dataPtr = exchPtr->dataPtr;
-            exchPtr->dataPtr = holdPtr;
-            result = _deleteDup(&(*root)->left, exchPtr->dataPtr, compare, freeData, NULL, destroy, atAddress, shorter);
-			if(*shorter)  {
-				dltRightBal(root, shorter);
-			}
-			return result;
-        }//else
+	for (top = depth; shorter && top > 0; )  {
+		link = path[--top];
+		if (wentLeft[top])  {
+			dltRightBal(link, &shorter);
+		}
+		else  {
+			dltLeftBal(link, &shorter);
+		}
+	}
+
+	if (destroy)  {
+		tree->freeData(holdPtr);
+	}
+	freeNode(tree->pool, dltPtr);
 
-}//_deleteDup
+	return holdPtr;
+}//_delete
 
 
 /****** dltRightBal *******************************************************************
@@ -1109,6 +2244,7 @@ static void dltLeftBal(TREE_NODE **root, int *shorter)
 								break;
 					case EH:	leftTree->bal = RH;
 								(*root)->bal = LH;
+								*shorter = 0;
 								break;
 					case RH:;	//cannot occur
 					}// switch leftTree->bal
@@ -1141,7 +2277,14 @@ static void rotateRight(TREE_NODE **root)
 //Statements
 	tempPtr = (*root)->left;
 	(*root)->left = tempPtr->right;
+	if (tempPtr->right)  {
+		tempPtr->right->parent = *root;
+	}
 	tempPtr->right = (*root);
+	tempPtr->parent = (*root)->parent;
+	(*root)->parent = tempPtr;
+	(*root)->size = 1 + SIZE_OF((*root)->left) + SIZE_OF((*root)->right);
+	tempPtr->size = 1 + SIZE_OF(tempPtr->left) + (*root)->size;
 
 	*root = tempPtr;
 
@@ -1162,7 +2305,14 @@ static void rotateLeft(TREE_NODE **root)
 //Statements
 	tempPtr = (*root)->right;
 	(*root)->right = tempPtr->left;
+	if (tempPtr->left)  {
+		tempPtr->left->parent = *root;
+	}
 	tempPtr->left = (*root);
+	tempPtr->parent = (*root)->parent;
+	(*root)->parent = tempPtr;
+	(*root)->size = 1 + SIZE_OF((*root)->left) + SIZE_OF((*root)->right);
+	tempPtr->size = 1 + (*root)->size + SIZE_OF(tempPtr->right);
 
 	*root = tempPtr;
 
@@ -1170,86 +2320,225 @@ static void rotateLeft(TREE_NODE **root)
 }//rotateLeft /*
 
 
-/****** _retrieve **********************************************************************
-	FUNCTION SPECIFIC TO DUPLICATE-REFUSING TREES
-	Searches tree for nodes matching the criteria contained in target. When a matching
-	node is found, it is stored in a TREE structure, matches, and the function returns 
-	success (1) to the caller. If the function reaches a NULL node, the data is not in
-	the tree and the function returns failure (0). Function always returns a TREE
-	regardless of the number of results returned. This is so that the public function
-	Retrieve can return multiple values  when called on a duplicate-allowing AVL tree.
-        PRE     root is pointer to the root TREE_NODE of the current [sub]tree
-                target is pointer to data structure containing key to be located
-				compare is a pointer to the compare function used to navigate the tree
-				matches is a pointer to the output TREE in which the matching results
-				will be	stored 
-        POST    tree searched; TREE containing matching data returned
-        RETURN  Address of data in matching node
-                If not found, NULL returned
+/****** _freezeFill ********************************************************************
+	Fills the snapshot subtree rooted at slot pos in order: left subtree, pos, right
+	subtree, taking the items from an iterator walking the tree in key order.
+        PRE     iter positioned on the item that belongs in the leftmost slot of the subtree
+        POST    slots of the subtree filled; iter moved past their items
+****************************************************************************************/
+static void _freezeFill(FROZEN_TREE *frozen, int pos, TREE_ITER *iter)
+{
+//Statements
+	if (pos > frozen->count)  {
+		return;
+	}
+	_freezeFill(frozen, 2 * pos, iter);
+	frozen->slots[pos].dataPtr = iter->current->dataPtr;
+	frozen->slots[pos].prefix = iter->current->prefix;
+	if (frozen->keys)  {
+		frozen->keys[pos] = *(int *)((char *)iter->current->dataPtr + frozen->tree->intKeyOffset);
+	}
+	IterNext(iter);
+	_freezeFill(frozen, 2 * pos + 1, iter);
+
+	return;
+}//_freezeFill
+
+
+/****** _frozenIntBound *******************************************************************
+	Branchless lower bound on the snapshot's int key array: each level moves to child 2i
+	or 2i + 1 according to one comparison, then the trailing right turns (1 bits) and the
+	last left turn are shifted off to land on the bound.
+        PRE     frozen->keys is filled
+        RETURN  slot position of the first key not less than key -or- 0 if none
 ****************************************************************************************/
-static int _retrieve(TREE_NODE *root, void *target, TREE *tree)
+static int _frozenIntBound(FROZEN_TREE *frozen, int key)
 {
 //Local Declarations
-	//int result;
+	const int *keys = frozen->keys;
+	unsigned int n = (unsigned int)frozen->count;
+	unsigned int i = 1;
 
 //Statements
-    if (root)
-    {
-        if (tree->compare(target, root->dataPtr) < 0)
-			return _retrieve(root->left, target, tree);
-        else if (tree->compare(target, root->dataPtr) > 0)
-            return _retrieve(root->right, target, tree);
-        else
-            //found equal key
-			enqueue(tree->searchResults, root->dataPtr);
-		return 1;
-    }//if root
-    else
-        //Data not in tree
-        return 0;
-}//_retrieve
-
-
-/****** _retrieveDup **********************************************************************
-	FUNCTION SPECIFIC TO DUPLICATE-ALLOWING TREES
-	Searches tree for nodes matching the criteria contained in target. When a matching
-	node is found, it is stored in a TREE structure, matches, success is set to 1, and the 
-	fuction continues to search first the left subtree, then the right for further matches. 
-	If the function reaches a NULL node, the data is not it returns failure (0). Successful
-	calls further up the recursion stack will still return 1Function always returns a TREE
-	regardless of the number of results returned. 
-        PRE     root is pointer to the root TREE_NODE of the current [sub]tree
-                target is pointer to data structure containing key to be located
-				compare is a pointer to the compare function used to navigate the tree
-				matches is a pointer to the output TREE in which the matching results
-				will be	stored 
-        POST    tree searched; TREE containing matching data returned
-        RETURN  Address of data in matching node
-                If not found, NULL returned
+	while (i <= n)  {
+		PREFETCH(keys + 16 * i);
+		i = 2 * i + (keys[i] < key);
+	}
+	while (i & 1)  {
+		i >>= 1;
+	}
+
+	return (int)(i >> 1);
+}//_frozenIntBound
+
+
+#ifdef __AVX2__
+/****** _frozenIntBound8 ******************************************************************
+	_frozenIntBound for eight keys at once. All lanes descend for the depth of the deepest
+	leaf; a lane that has already left the array takes right turns, which the final shift
+	strips off again, so every lane ends on the same position the scalar search would.
+        PRE     frozen->keys is filled
+        POST    pos[lane] is the bound for keys[lane] (0 if none)
+****************************************************************************************/
+static void _frozenIntBound8(FROZEN_TREE *frozen, const int *keys, int *pos)
+{
+//Local Declarations
+	const __m256i one = _mm256_set1_epi32(1);
+	const __m256i n = _mm256_set1_epi32(frozen->count);
+	const __m256i key = _mm256_loadu_si256((const __m256i *)keys);
+	__m256i idx = one;
+	__m256i inside;
+	__m256i slot;
+	__m256i right;
+	unsigned int level;
+	unsigned int i;
+	int lane;
+
+//Statements
+	for (level = (unsigned int)frozen->count; level; level >>= 1)  {
+		inside = _mm256_cmpgt_epi32(_mm256_add_epi32(n, one), idx);
+		slot = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), frozen->keys, idx, inside, 4);
+		//right turn where the slot key is less than the key, or the lane has left the array
+		right = _mm256_or_si256(_mm256_cmpgt_epi32(key, slot), _mm256_xor_si256(inside, _mm256_set1_epi32(-1)));
+		idx = _mm256_sub_epi32(_mm256_add_epi32(idx, idx), right);
+	}
+	_mm256_storeu_si256((__m256i *)pos, idx);
+	for (lane = 0; lane < 8; lane++)  {
+		i = (unsigned int)pos[lane];
+		while (i & 1)  {
+			i >>= 1;
+		}
+		pos[lane] = (int)(i >> 1);
+	}
+
+	return;
+}//_frozenIntBound8
+#endif
+
+
+/****** _reclaim ********************************************************************
+	Releases the retired items no reader can reach. An item retired in epoch e is reachable
+	only from snapshots readers may load while the epoch is still e or earlier, so it is
+	released once the epoch has moved past e and every reader inside entered after e.
+        PRE     the caller is the only writer
+        POST    unreachable items released; the first retired snapshot becomes the spare
+***************************************************************************************/
+static void _reclaim(PUBLISHED_TREE *pub)
+{
+//Local Declarations
+	unsigned long oldest = pub->epoch;
+	unsigned long epoch;
+	RETIRED **link = &pub->retired;
+	RETIRED *item;
+	int i;
+
+//Statements
+	for (i = 0; i < AVL_MAX_READERS; i++)  {
+		epoch = __atomic_load_n(&pub->readers[i].epoch, __ATOMIC_SEQ_CST);
+		if (epoch && epoch < oldest)  {
+			oldest = epoch;
+		}
+	}
+	while ((item = *link))  {
+		if (item->epoch >= oldest)  {
+			link = &item->next;
+			continue;
+		}
+		*link = item->next;
+		if (item->release)  {
+			item->release(item->dataPtr);
+		}
+		else if (!pub->spare)  {
+			pub->spare = (FROZEN_TREE*) item->dataPtr;
+		}
+		else  {
+			DestroyFrozenTree((FROZEN_TREE*) item->dataPtr);
+		}
+		free(item);
+	}
+	return;
+}//_reclaim
+
+
+/****** _compareSlot **********************************************************************
+	Compares a search key, whose prefix has already been computed, with a snapshot slot, as
+	_compareNode does for a tree node.
+        PRE     tree is the snapshot's tree; prefix is _prefix(tree, key)
+        RETURN  negative, zero or positive as compare would
+****************************************************************************************/
+static int _compareSlot(TREE *tree, void *key, unsigned long long prefix, FROZEN_SLOT *slot)
+{
+//Statements
+	if (tree->usePrefix && prefix != slot->prefix)  {
+#ifdef AVL_COUNT_COMPARES
+		tree->compares++;
+#endif
+		return (prefix < slot->prefix) ? -1 : 1;
+	}
+	return _compare(tree, key, slot->dataPtr);
+}//_compareSlot
+
+
+/****** _descendBound ******************************************************************
+	Walks from the root toward key, comparing each node on the path exactly once. Every
+	node at which the walk turns left is a candidate bound and is pushed, so the top of
+	the stack ends up on the bound and the nodes below it are its remaining in-order
+	successors along the path.
+		lower bound (upper = 0): turn left when key <= node (first node not less than key)
+		upper bound (upper = 1): turn left when key <  node (first node greater than key)
+        PRE     tree has been created (may be null)
+				key is pointer to data structure containing the key to be located
+				cursor is pointer to a caller-owned TREE_CURSOR
+        POST    cursor positioned on the bound with no end limit
+		RETURN	true (1) if the bound found compares equal to key -or- false (0)
 ****************************************************************************************/
-static int _retrieveDup(TREE_NODE *root, void *target, TREE *tree)
+static int _descendBound(TREE *tree, void *key, TREE_CURSOR *cursor, int upper)
 {
 //Local Declarations
+	TREE_NODE *root;
+	unsigned long long prefix;
 	int result;
+	int equal = 0;
 
 //Statements
-    if (root)
-    {
-        if (tree->compare(target, root->dataPtr) < 0)
-			return _retrieveDup(root->left, target, tree);
-        else if (tree->compare(target, root->dataPtr) > 0)
-            return _retrieveDup(root->right, target,tree);
-        else
-            //found equal key
-			result = _retrieveDup(root->left, target, tree);
-			enqueue(tree->searchResults, root->dataPtr);
-            result  |= _retrieveDup(root->right, target, tree);
-			return result;
-    }//if root
-    else
-        //Data not in tree
-        return 0;
-}//_retrieveDup
+	cursor->top = 0;
+	cursor->end = NULL;
+	root = tree ? tree->root : NULL;
+	prefix = root ? _prefix(tree, key) : 0;
+
+	while (root)  {
+		result = _compareNode(tree, key, prefix, root);
+		if (result < 0 || (result == 0 && !upper))  {
+			cursor->stack[(cursor->top)++] = root;
+			equal = (result == 0);
+			root = root->left;
+		}
+		else  {
+			root = root->right;
+		}
+	}
+
+	return equal;
+}//_descendBound
+
+
+/****** _pushLeft *************************************************************************
+	Pushes root and its chain of left descendants onto the cursor; the last pushed is the
+	smallest node of the subtree.
+        PRE     cursor is a valid TREE_CURSOR
+				root is a subtree (may be null)
+        POST    left edge of subtree pushed
+****************************************************************************************/
+static void _pushLeft(TREE_CURSOR *cursor, TREE_NODE *root)
+{
+//Statements
+	while (root)  {
+		cursor->stack[(cursor->top)++] = root;
+		root = root->left;
+	}
+
+	return;
+}//_pushLeft
 
 
 /****** _traverse *********************************************************************
@@ -1276,31 +2565,28 @@ static void _traverse (TREE_NODE *root, void (*process) (void *dataPtr))
     progressive indent
         PRE     tree is a valid BST containing data
                 print is a pointer to a type-specific print function (application)
+				level is the depth of root (1 for the tree's root); it is passed down rather
+					than kept in a static so concurrent prints don't share it
         POST    tree printed in hierarchical format
 **********************************************************************************************/
-static void _printNested(TREE_NODE *root, void (*print)(void *dataPtr), int showNums)
+static void _printNested(TREE_NODE *root, void (*print)(void *dataPtr), int showNums, int level)
 {
 //Local Declarations
-    static int level = 0;
-	int currentLevel;
     int i;
 
 //Statements
 
     if(root)  {
-		currentLevel = ++level;
-        _printNested(root->right, print, showNums);
-        level = currentLevel;
-		for (i = 1; i < currentLevel; i++)  {
+        _printNested(root->right, print, showNums, level + 1);
+		for (i = 1; i < level; i++)  {
             printf("   ");
 		}
-			if(showNums) printf("%d. ", currentLevel);
+			if(showNums) printf("%d. ", level);
 			//printf(" Bal: %d  ", root->bal);
 			print(root->dataPtr);
-        _printNested(root->left, print, showNums);
+        _printNested(root->left, print, showNums, level + 1);
     }
 
-    level = 0;
     return;
 }//_printNested
 
@@ -1342,26 +2628,142 @@ static int _filter  (TREE_NODE *root,
 				freeData is a pointer to an application-supplied function to recycle stored data
 					If stored data structures do not contain external dynamically allocated
 					members, the standard free() function will suffice.
+				pool is the NODE_POOL the nodes are handed back to -or- NULL if the nodes will be
+					released along with the pool's chunks
         POST    All TREE_NODEs recycled. If DESTROY, data also recycled.
         RETURN  null head pointer
 **********************************************************************************************/
-static void _destroy(TREE_NODE *root, enum destConst destroyData, void (*freeData)(void *dataPtr))
+static void _destroy(TREE_NODE *root, enum destConst destroyData, void (*freeData)(void *dataPtr),
+						NODE_POOL *pool)
 {
+//Local Declarations
+	TREE_NODE *right;
+
 //Statements
     if(root)
     {
-        _destroy(root->left, destroyData, freeData);
+        _destroy(root->left, destroyData, freeData, pool);
         if(destroyData) {
             freeData(root->dataPtr);
         }
-        _destroy(root->right, destroyData, freeData);
-        free(root);
+		right = root->right;
+		if(pool)  {
+			freeNode(pool, root);
+		}
+        _destroy(right, destroyData, freeData, pool);
 		return;
     }//if
 	return;
 }//_destroy
 
 
+/****** createPool ***************************************************************************
+	Allocates an empty NODE_POOL. No chunks are allocated until the first node is requested.
+		POST	pool allocated with a reference count of one
+		RETURN	pool -or- NULL if overflow
+**********************************************************************************************/
+static NODE_POOL *createPool(void)
+{
+//Local Declarations
+	NODE_POOL *pool;
+
+//Statements
+	pool = (NODE_POOL*) malloc(sizeof(NODE_POOL));
+	if (pool)  {
+		pool->chunks = NULL;
+		pool->freeList = NULL;
+		pool->nextChunkSize = POOL_FIRST_CHUNK;
+		pool->refCount = 1;
+	}
+
+	return pool;
+}//createPool
+
+
+/****** releasePool **************************************************************************
+	Drops one reference to a pool. When the last reference is dropped every chunk is freed,
+	which recycles all of the pool's nodes in O(chunks) rather than O(nodes).
+		PRE		pool is a valid NODE_POOL
+		POST	reference dropped; pool and chunks recycled if no longer referenced
+		RETURN	NULL
+**********************************************************************************************/
+static NODE_POOL *releasePool(NODE_POOL *pool)
+{
+//Local Declarations
+	NODE_CHUNK *dltPtr;
+
+//Statements
+	if (pool && --(pool->refCount) == 0)  {
+		while (pool->chunks)  {
+			dltPtr = pool->chunks;
+			pool->chunks = dltPtr->next;
+			free(dltPtr);
+		}
+		free(pool);
+	}
+
+	return NULL;
+}//releasePool
+
+
+/****** allocNode ****************************************************************************
+	Takes a node off the pool's free list. When the free list is empty a new chunk is
+	allocated (each chunk twice the size of the last, up to POOL_MAX_CHUNK nodes) and its
+	nodes are threaded onto the free list.
+		PRE		pool is a valid NODE_POOL
+		RETURN	uninitialized TREE_NODE -or- NULL if overflow
+**********************************************************************************************/
+static TREE_NODE *allocNode(NODE_POOL *pool)
+{
+//Local Declarations
+	NODE_CHUNK *chunk;
+	TREE_NODE *node;
+	int i;
+
+//Statements
+	if (!pool->freeList)  {
+		chunk = (NODE_CHUNK*) malloc(sizeof(NODE_CHUNK) + pool->nextChunkSize * sizeof(TREE_NODE));
+		if (!chunk)  {
+			return NULL;
+		}
+		chunk->size = pool->nextChunkSize;
+		chunk->next = pool->chunks;
+		pool->chunks = chunk;
+
+		//thread new nodes onto free list in address order
+		for (i = 0; i < chunk->size - 1; i++)  {
+			chunk->nodes[i].left = &chunk->nodes[i + 1];
+		}
+		chunk->nodes[chunk->size - 1].left = NULL;
+		pool->freeList = chunk->nodes;
+
+		if (pool->nextChunkSize < POOL_MAX_CHUNK)  {
+			pool->nextChunkSize *= 2;
+		}
+	}
+
+	node = pool->freeList;
+	pool->freeList = node->left;
+
+	return node;
+}//allocNode
+
+
+/****** freeNode *****************************************************************************
+	Returns a node to its pool's free list.
+		PRE		node was allocated from pool
+		POST	node at head of free list
+**********************************************************************************************/
+static void freeNode(NODE_POOL *pool, TREE_NODE *node)
+{
+//Statements
+	node->left = pool->freeList;
+	pool->freeList = node;
+
+	return;
+}//freeNode
+
+
 
 /****** GetFirst *****************************************************************************
 	Function walks down the left side of a tree until the first node without a left child is
@@ -1380,7 +2782,7 @@ void *GetFirst (TREE *tree)
 		while(current->left)  {
 			current = current->left;
 		}
-		return current;
+		return current->dataPtr;
 	}
 
 	return NULL;
@@ -18,9 +18,29 @@ typedef struct tree_node
     void*					dataPtr;
     struct tree_node*		left;
     struct tree_node*		right;
-	enum   balanceFactor	bal;
+    struct tree_node*		parent;
+	unsigned long long		prefix;			//cached key prefix (SetIntKey/SetKeyPrefix), else 0
+	int						size;			//nodes in the subtree rooted here
+	signed char				bal;			//a balanceFactor (LH, EH or RH)
 }TREE_NODE;
 
+//Nodes are carved out of chunks owned by a pool rather than malloc'd one at a time.
+//Free nodes are threaded through their left pointers.
+typedef struct node_chunk
+{
+	struct node_chunk*		next;
+	int						size;
+	TREE_NODE				nodes[];
+}NODE_CHUNK;
+
+typedef struct
+{
+	NODE_CHUNK*				chunks;
+	TREE_NODE*				freeList;
+	int						nextChunkSize;
+	int						refCount;
+}NODE_POOL;
+
 typedef struct
 {
     int count;
@@ -30,8 +50,83 @@ typedef struct
     void *(*getNew)(void);
     TREE_NODE *root;
 	QUEUE *searchResults;
+	NODE_POOL *pool;
+	int intKeyOffset;		//>= 0: items hold an int key here, compared inline (SetIntKey)
+	unsigned long long (*getPrefix)(void *dataPtr);	//order-preserving key prefix (SetKeyPrefix)
+	int usePrefix;			//nodes carry a prefix to compare before the data
+#ifdef AVL_COUNT_COMPARES
+	unsigned long compares;	//key comparisons made (CompareCount)
+#endif
 } TREE;
 
+//An AVL tree of n nodes is less than 1.45 log2(n + 2) high, so 64 levels covers any int count
+#define AVL_MAX_HEIGHT 64
+
+//Caller-owned iterator position. Moves in either direction through the parent links; valid
+//until the tree is next modified (resume afterwards with IterSeek).
+typedef struct
+{
+	TREE					*tree;
+	TREE_NODE				*current;
+} TREE_ITER;
+
+//Caller-owned in-order position in a tree. The stack holds the nodes still to be visited
+//whose right subtrees have not been entered; the walk stops on reaching end (NULL = end of
+//tree). Valid until the tree is next modified.
+typedef struct
+{
+	TREE_NODE				*stack[AVL_MAX_HEIGHT];
+	TREE_NODE				*end;
+	int						top;
+} TREE_CURSOR;
+
+//Read-only snapshot of a tree (FreezeTree). slots[1..count] hold the tree's data in
+//Eytzinger order: the children of slot i are slots 2i and 2i + 1. Slot 0 is unused.
+//If the tree has an int key, keys[i] is the key of slots[i]; otherwise keys is NULL.
+typedef struct
+{
+	unsigned long long		prefix;
+	void					*dataPtr;
+} FROZEN_SLOT;
+
+typedef struct
+{
+	TREE					*tree;
+	FROZEN_SLOT				*slots;
+	int						*keys;
+	int						count;
+	int						capacity;
+} FROZEN_TREE;
+
+//Snapshots published for lock-free readers (PublishTree). One writer at a time modifies the
+//tree and calls Republish; readers bracket their use of current with ReaderEnter/ReaderExit.
+//A replaced snapshot, and any data handed to RetireData, is released only once no reader
+//that could still see it remains (epoch-based reclamation).
+#define AVL_MAX_READERS		64		//readers inside ReaderEnter/ReaderExit at one time
+
+typedef struct
+{
+	unsigned long			epoch;			//epoch the reader entered in; 0 if the slot is free
+	char					pad[64 - sizeof(unsigned long)];	//one reader per cache line
+} READER_SLOT;
+
+typedef struct retired
+{
+	void					*dataPtr;
+	void					(*release)(void *dataPtr);	//NULL: dataPtr is a FROZEN_TREE
+	unsigned long			epoch;			//last epoch in which a reader could reach it
+	struct retired			*next;
+} RETIRED;
+
+typedef struct
+{
+	FROZEN_TREE				*current;		//the published snapshot
+	FROZEN_TREE				*spare;			//a reclaimed snapshot, refilled by the next Republish
+	unsigned long			epoch;			//advanced by every Republish; starts at 1
+	RETIRED					*retired;
+	READER_SLOT				readers[AVL_MAX_READERS];
+} PUBLISHED_TREE;
+
 //Prototype Declarations
 TREE    *CreateTree         (int (*compare)(void  *argu1, void *argu2),
                                 void (*freeData)(void *arg1),
@@ -41,11 +136,48 @@ TREE    *DestroyTree        (TREE *tree, enum destConst destroyData);
 
 void    *InsertNew          (TREE *tree);
 int     Insert              (TREE *tree, void *dataPtr);
+int		BuildTreeSorted		(TREE *tree, void **items, int n);
 
 int		Search				(TREE *tree, void *target);
 void	*GetNextResult		(TREE *tree);
 void	FlushSearch			(TREE *tree);
 
+void	*SearchFirst		(TREE *tree, void *target, TREE_CURSOR *cursor);
+void	*SearchNext			(TREE_CURSOR *cursor);
+int		SearchInto			(TREE *tree, void *target, void **results, int maxResults);
+int		SearchBatch			(TREE *tree, void **keys, void **results, int n);
+
+int		LowerBound			(TREE *tree, void *key, TREE_CURSOR *cursor);
+int		UpperBound			(TREE *tree, void *key, TREE_CURSOR *cursor);
+int		EqualRange			(TREE *tree, void *key, TREE_CURSOR *cursor);
+void	*CursorNext			(TREE_CURSOR *cursor);
+
+void	*IterBegin			(TREE *tree, TREE_ITER *iter);
+void	*IterLast			(TREE *tree, TREE_ITER *iter);
+void	*IterSeek			(TREE *tree, void *key, TREE_ITER *iter);
+void	*IterNext			(TREE_ITER *iter);
+void	*IterPrev			(TREE_ITER *iter);
+
+void	*SelectAt			(TREE *tree, int k);
+int		RankOf				(TREE *tree, void *key);
+
+FROZEN_TREE	*FreezeTree			(TREE *tree);
+int			RefreezeTree		(FROZEN_TREE *frozen);
+FROZEN_TREE	*DestroyFrozenTree	(FROZEN_TREE *frozen);
+int			FrozenLowerBound	(FROZEN_TREE *frozen, void *key);
+int			FrozenNext			(FROZEN_TREE *frozen, int pos);
+void		*FrozenAt			(FROZEN_TREE *frozen, int pos);
+int			FrozenSearchInto	(FROZEN_TREE *frozen, void *target, void **results, int maxResults);
+void		*FrozenFindInt		(FROZEN_TREE *frozen, int key);
+int			FrozenFindInts		(FROZEN_TREE *frozen, const int *keys, void **results, int n);
+
+PUBLISHED_TREE	*PublishTree		(TREE *tree);
+int				Republish			(PUBLISHED_TREE *pub);
+int				RetireData			(PUBLISHED_TREE *pub, void *dataPtr, void (*release)(void *dataPtr));
+FROZEN_TREE		*ReaderEnter		(PUBLISHED_TREE *pub, int *slot);
+void			ReaderExit			(PUBLISHED_TREE *pub, int slot);
+PUBLISHED_TREE	*DestroyPublished	(PUBLISHED_TREE *pub);
+
 void    Traverse            (TREE *tree, void (*process)(void* dataPtr));
 
 int     Filter              (TREE *tree, int (*compare)(void *arg1, void *arg2),
@@ -64,6 +196,10 @@ int     FullTree            (TREE *tree);
 int     TreeCount           (TREE *tree);
 
 void	allowDup			(TREE *tree, int value);
+void	SetIntKey			(TREE *tree, int offset);
+void	SetKeyPrefix		(TREE *tree, unsigned long long (*getPrefix)(void *dataPtr));
+unsigned long	CompareCount	(TREE *tree, int reset);
+int		ShareNodePool		(TREE *tree, TREE *source);
 
 void*   GetFirst			(TREE *tree);
 void*   GetLast		        (TREE *tree);
@@ -1,12 +1,14 @@
+#include <limits.h>
 #include "team.h"
 
-#define MAXMYINT   500000
-#define  K     80
-#define  DIM   K * 1024LU
-#define  NMAX  8LU * DIM
 
+static unsigned long long mulMod(unsigned long long a, unsigned long long b, unsigned long long m);
+static unsigned long long powMod(unsigned long long a, unsigned long long e, unsigned long long m);
+static unsigned long long mix64(unsigned long long x);
 
-unsigned long sieve(unsigned long num);
+#define HASH_MULT 0x9E3779B97F4A7C15ULL
+
+static unsigned long long hashSeed = 0x243F6A8885A308D3ULL;
 	
 
 
@@ -14,8 +16,10 @@ unsigned long sieve(unsigned long num);
 
 
 /*
-	 * Function to return an index into the hash table.  The function simply adds up
-	 * the values of the char's in the string.
+	 * Function to return an index into the hash table.  The id is hashed
+	 * with hashBytes (seeded, see setHashSeed); the usual five character
+	 * id is loaded as a single word and mixed once, which gives the same
+	 * value hashBytes would.
 	 *
 	 * Parameter:
 	 * key:	pointer to a character string
@@ -26,10 +30,68 @@ unsigned long sieve(unsigned long num);
 
 int getHashKey(void* record, int size)
 { 
-	char* key = ((PRISONER*)record)->id;
-	int hashval;
-	for (hashval = 0 ; *key != '\0' ; hashval += *key++);
-	return (hashval % size); 
+	const unsigned char* key = (const unsigned char*)((PRISONER*)record)->id;
+	unsigned long long hashval;
+
+	if (key[0] && key[1] && key[2] && key[3] && key[4] && !key[5])
+		hashval = mix64(hashSeed ^ 5 * HASH_MULT ^
+		                ((unsigned long long)key[0]       | (unsigned long long)key[1] << 8 |
+		                 (unsigned long long)key[2] << 16 | (unsigned long long)key[3] << 24 |
+		                 (unsigned long long)key[4] << 32));
+	else
+		hashval = hashBytes(key, strlen((const char*)key), hashSeed);
+	return (int)((hashval >> 1) % (unsigned long long)size); 
+}
+
+/* ================ setHashSeed ===================
+ * Changes the seed used by getHashKey. Only call it while no hash table
+ * built with getHashKey holds records.
+ * Pre: any seed
+ * Post: seed replaced
+ */
+void setHashSeed(unsigned long long seed)
+{
+	hashSeed = seed;
+}
+
+/* ================ mix64 ===================
+ * Pre: any value
+ * Post: return the value with every input bit spread over the output
+ *       (the splitmix64 finalizer)
+ */
+static unsigned long long mix64(unsigned long long x)
+{
+	x ^= x >> 30;
+	x *= 0xBF58476D1CE4E5B9ULL;
+	x ^= x >> 27;
+	x *= 0x94D049BB133111EBULL;
+	x ^= x >> 31;
+	return x;
+}
+
+/* ================ hashBytes ===================
+ * Hashes len bytes eight at a time (little-endian words), folding each
+ * word into the state with mix64; the length and seed are folded in
+ * first so keys that differ only by trailing zero bytes still differ.
+ * Pre: key points to len bytes
+ * Post: return a 64-bit hash
+ */
+unsigned long long hashBytes(const void* key, size_t len, unsigned long long seed)
+{
+	const unsigned char* p = (const unsigned char*)key;
+	unsigned long long h = seed ^ len * HASH_MULT;
+	unsigned long long word;
+	size_t i, n;
+
+	do {
+		n = len < 8 ? len : 8;
+		for (word = 0, i = 0; i < n; i++)
+			word |= (unsigned long long)p[i] << (8 * i);
+		h = mix64(h ^ word);
+		p += n;
+		len -= n;
+	} while (len);
+	return h;
 }
 
 /***********************************************
@@ -44,58 +106,99 @@ int getHashKey(void* record, int size)
 
 void cleanUp(HASH** hash, TREE** nameTree, TREE** idTree)
 {
-	HASH_SaveFile(*hash, getName("output file", 1), writeFile);
+	saveRecords(*hash, getName("output file", 1));
 	*hash = HASH_Destroy(*hash, NULL);
 	*nameTree = DestroyTree(*nameTree, PRESERVE);
 	*idTree = DestroyTree(*idTree, DESTROY);
 }
 
 
-/* ================ sieve ===================
- * This function will find the last prime
- * Pre: unsigned long number
- * Post: return the last prime number
+/* ================ mulMod ===================
+ * Pre: m > 0, a and b below m
+ * Post: return a * b mod m without overflowing 64 bits
+ */
+static unsigned long long mulMod(unsigned long long a, unsigned long long b, unsigned long long m)
+{
+#ifdef __SIZEOF_INT128__
+	return (unsigned long long)((unsigned __int128)a * b % m);
+#else
+	unsigned long long result = 0;
+
+	for ( ; b; b >>= 1) {
+		if (b & 1)
+			result = result >= m - a ? result - (m - a) : result + a;
+		a = a >= m - a ? a - (m - a) : a + a;
+	}
+	return result;
+#endif
+}
+/* ================ powMod ===================
+ * Pre: m > 0
+ * Post: return a^e mod m
+ */
+static unsigned long long powMod(unsigned long long a, unsigned long long e, unsigned long long m)
+{
+	unsigned long long result = 1 % m;
+
+	for (a %= m; e; e >>= 1) {
+		if (e & 1)
+			result = mulMod(result, a, m);
+		a = mulMod(a, a, m);
+	}
+	return result;
+}
+/* ================ isPrime ===================
+ * Deterministic Miller-Rabin: the first twelve prime bases are enough
+ * for every 64-bit number, so no table or sieve is needed.
+ * Pre: any number
+ * Post: return 1 if n is prime, 0 otherwise
+ */
+int isPrime(unsigned long long n)
+{
+	static const unsigned long long bases[] = { 2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37 };
+	unsigned long long d, x;
+	int i, r, s;
+
+	if (n < 2)
+		return 0;
+	for (i = 0; i < 12; i++)
+		if (n % bases[i] == 0)
+			return n == bases[i];
+
+	for (d = n - 1, s = 0; !(d & 1); d >>= 1, s++)
+		;
+	for (i = 0; i < 12; i++) {
+		x = powMod(bases[i], d, n);
+		if (x == 1 || x == n - 1)
+			continue;
+		for (r = 1; r < s && x != n - 1; r++)
+			x = mulMod(x, x, n);
+		if (x != n - 1)
+			return 0;
+	}
+	return 1;
+}
+/* ============== nextPrime ================
+ * Pre: n below the largest 64-bit prime
+ * Post: return the smallest prime greater than n
  */
-unsigned long sieve(unsigned long num)
+unsigned long long nextPrime(unsigned long long n)
 {
-    char bit[DIM];
-    char bit0[] = { (char)0x7F, (char)0xBF, (char)0xDF, (char)0xEF, (char)0xF7, (char)0xFB, (char)0xFD, (char)0xFE };
-
-    #define  is_prime(x)  ((bit[(x - 1) / 8]) >> (7 - (x - 1) % 8))  & 1
-    #define  delete_m(mx)   bit[(mx - 1) / 8] &= bit0[(int)((mx - 1) % 8)]
-
-    unsigned long n, i, max_prime;
-
-	for ( i = 0; i < DIM; bit[i++] = (char)0xFF )
-        ;
-    
-	for ( n = 2; n <= num; n++ ) 
-		if ( is_prime( n ) ) {
-			max_prime = n;   
-			for ( i = 2 * n; i <= num; i += n ) 
-				delete_m( i );                  
-		}
-    
-    return max_prime;
+	if (n < 2)
+		return 2;
+	for (n = (n + 1) | 1; !isPrime(n); n += 2)
+		;
+	return n;
 }
 /* ============== getPrime ================
- * This function will find the next prime for numbers up to 500,000
+ * This function will find the next prime, used to size the hash table.
  * Pre: one integer
- * Post: return the next prime 
+ * Post: return the smallest prime greater than x, or INT_MAX (a prime)
+ *       if there is none that fits in an int
  */
 int getPrime(int x)
 {
-	int lastPrime;
-	int myPrime;
-
-	if (x < MAXMYINT)
-	{
-		lastPrime = (int)sieve(x);
-		while (x < MAXMYINT && lastPrime == (myPrime = (int)sieve(x++)));
-	}
-	else
-		myPrime = 500009;
-
-	return myPrime;
+	if (x >= INT_MAX - 1)
+		return INT_MAX;
+	return (int)nextPrime(x < 0 ? 0 : (unsigned long long)x);
 }
-
@@ -4,39 +4,192 @@
 
     Public Functions:
 		HASH_Create
+		HASH_CreateEngine
 		HASH_Destroy
 		HASH_Insert
 		HASH_Delete
 		HASH_Retrieve
+		HASH_RetrieveBatch
 		HASH_Traverse
 		HASH_Empty
 		HASH_Load
 		HASH_Count
+		HASH_GetLongestList
+		HASH_ChainCount
+		HASH_SetIntKey
+		HASH_GetSlots
+		HASH_SetSlots
+		HASH_SaveFileBuffered
+		HASH_ReHash
+		HASH_ReHashIncremental
+
+    The number of non-empty buckets, the longest list and a histogram of list
+    lengths are updated on every insert and delete, so HASH_Load,
+    HASH_GetLongestList and HASH_ChainCount are O(1) instead of scanning
+    every bucket.
+
+    Two engines sit behind the same functions, chosen at creation:
+        HASH_CHAINED - an array of sorted linked lists (HASH_Create).
+        HASH_OPEN    - Robin Hood open addressing. Records live directly in
+                       an array of slots along with their full hash value,
+                       so a probe only calls compare (and touches the record)
+                       when the cached hash matches. Entries far from their
+                       home slot displace entries closer to theirs, which keeps
+                       probe sequences short, and a lookup can stop as soon as
+                       it meets an entry nearer its home than the key would be.
+                       Deletes shift the following entries back one slot
+                       instead of leaving tombstones. The record's full hash is
+                       getHashKey(record, INT_MAX); its home slot is that value
+                       modulo maxSize. The list-length statistics count the
+                       probe length at which each record is found.
+
+    HASH_ReHash moves every record into a larger table at once.
+    HASH_ReHashIncremental only allocates the larger table and keeps the old
+    one hanging off it; each later insert or delete moves HASH_MIGRATE_STEP
+    buckets across, so no single call pays for the whole table. Until the old
+    table is empty, retrieve, delete and the traversals look at both tables.
+    Retrieve never moves records, so lookups stay read-only and any number
+    of threads may retrieve at once while nothing is inserting or deleting. Load and the
+    list-length statistics describe the new table only.
+
+    HASH_RetrieveBatch looks up many keys at once in groups of
+    HASH_BATCH_GROUP: it hashes every key in the group and prefetches its
+    bucket first, then probes them in turn, so the cache misses of the group
+    overlap instead of being paid one after another.
+
+    HASH_GetSlots and HASH_SetSlots hand an open table's layout out and back
+    in, so a table can be stored (as a snapshot does) and rebuilt in one pass
+    over its slots instead of one probe sequence per record.
+
+    HASH_SaveFileBuffered writes every record through a formatting callback
+    into large buffers instead of one stdio call per record, and can split
+    the buckets between threads that each format their share into buffers
+    of their own. The shares are written in bucket order, each as soon as
+    the ones before it are done, so the file is the same whatever the number
+    of threads and a thread holds at most SAVE_CHUNKS buffers meanwhile.
 
     Change Log:
         _05/24 @4.30pm: All the functions should work.
 */
 
 #include <stdlib.h>
+#include <limits.h>
+#include <pthread.h>
 #include "hashADT.h"
+
+#define CHAIN_COUNTS_START 16
+#define HASH_BATCH_GROUP   16
+#define SAVE_BUFFER_SIZE   (1 << 20)
+#define SAVE_ALIGN         4096
+#define SAVE_CHUNKS        4        // buffers a part fills before it must wait its turn
+
+// what the parts of one HASH_SaveFileBuffered share: the file, and whose
+// turn it is to write to it (parts write in order, each only on its turn)
+typedef struct
+{
+    FILE* fpOut;
+    int   turn;
+    pthread_mutex_t lock;
+    pthread_cond_t  turned;
+}SAVE_FILE;
+
+// one thread's share of HASH_SaveFileBuffered: buckets from..to-1, counting
+// the old table's buckets after the new table's
+typedef struct
+{
+    HASH* pHash;
+    int   from;
+    int   to;
+    int   index;            // the part's place in the file
+    int   (*format)(char* buf, int size, void* dataPtr);
+    SAVE_FILE* file;
+    char* buf[SAVE_CHUNKS]; // aligned buffers, buf[chunks - 1] being filled
+    int   len[SAVE_CHUNKS];
+    int   cap[SAVE_CHUNKS];
+    int   chunks;
+    long long written;      // bytes already written to the file
+    bool  failed;
+}SAVE_PART;
+
+#ifdef __GNUC__
+#define PREFETCH(addr) __builtin_prefetch(addr)
+#else
+#define PREFETCH(addr)
+#endif
+
+static bool _growChainCounts(HASH* pHash, int length);
+static void _chainChanged(HASH* pHash, int oldLength, int newLength);
+
+static int   _openInsert   (HASH* pHash, void* dataPtr);
+static int   _openFind     (HASH* pHash, void* keyPtr);
+static int   _openProbe    (HASH* pHash, void* keyPtr, unsigned int hash);
+static void* _openDelete   (HASH* pHash, int pos);
+static int   _openDistance (HASH* pHash, int pos);
+static int   _keyCompare   (HASH* pHash, void* argu1, void* argu2);
+
+static int   _tableInsert   (HASH* pHash, void* dataPtr);
+static void* _tableDelete   (HASH* pHash, void* dltKey);
+static void* _tableRetrieve (HASH* pHash, void* keyPtr);
+static void  _tableSave     (HASH* pHash, FILE* fpOut,
+                             void (*processData)(FILE *fpOut, void* dataPtr));
+static void  _migrate       (HASH* pHash, int buckets);
+
+static void  _saveRange     (SAVE_PART* part);
+static void* _saveThread    (void* part);
+static bool  _saveRecord    (SAVE_PART* part, void* dataPtr);
+static bool  _saveChunk     (SAVE_PART* part, int chunk, int size);
+static bool  _saveTurn      (SAVE_PART* part, bool wait);
+static bool  _saveFlush     (SAVE_PART* part);
+static void  _saveFinish    (SAVE_PART* part);
+
 /**	================= HASH_Create ================
 	   Pre
-	   Post
+	   Post: _chained hash table created (see HASH_CreateEngine)
 */
 HASH* HASH_Create(int (*getHashKey)(void* argu1, int hashSize),
                     int (*compare) (void* argu1, void* argu2),
                     int maxSize)
+{
+    return HASH_CreateEngine(getHashKey, compare, maxSize, HASH_CHAINED);
+}
+/**	================= HASH_CreateEngine ================
+	   Pre:  engine is HASH_CHAINED or HASH_OPEN
+	   Post: _return the new table, or NULL if memory could not be allocated
+*/
+HASH* HASH_CreateEngine(int (*getHashKey)(void* argu1, int hashSize),
+                    int (*compare) (void* argu1, void* argu2),
+                    int maxSize,
+                    HASH_ENGINE engine)
 {
     int i;
 
     HASH *pTemp = NULL;
     pTemp = (HASH *)malloc(sizeof(HASH));
     if(pTemp){
+        pTemp->engine = engine;
         pTemp->count = 0;
         pTemp->maxSize = maxSize;
         pTemp->compare = compare;
         pTemp->getHashKey = getHashKey;
+        pTemp->intKeyOffset = -1;
         pTemp->longestList = 0;
+        pTemp->nonEmpty = 0;
+        pTemp->chainCountsSize = 0;
+        pTemp->chainCounts = NULL;
+        _growChainCounts(pTemp, CHAIN_COUNTS_START);
+        pTemp->hashList = NULL;
+        pTemp->slots = NULL;
+        pTemp->old = NULL;
+        pTemp->migrateNext = 0;
+        if(engine == HASH_OPEN){
+            pTemp->slots = (HASH_SLOT *)calloc(maxSize, sizeof(HASH_SLOT));
+            if(!pTemp->slots){
+                free(pTemp->chainCounts);
+                free(pTemp);
+                return NULL;
+            }
+            return pTemp;
+        }
         pTemp->hashList = (LIST **)malloc(maxSize * sizeof(LIST *));
         if(pTemp->hashList){
             for(i = 0; i < maxSize; i++){
@@ -57,11 +210,23 @@ HASH* HASH_Destroy (HASH* pHash,
                     void (*process)(void **dataOut))
 {
     int i;
-    for(i = 0; i < pHash->maxSize; i++){
-            destroyList(pHash->hashList[i], process);
+    if(pHash->old)
+        HASH_Destroy(pHash->old, process);
+    if(pHash->engine == HASH_OPEN){
+        for(i = 0; i < pHash->maxSize; i++){
+            if(pHash->slots[i].dataPtr && process)
+                process(pHash->slots[i].dataPtr);
+        }
+        free(pHash->slots);
+    }
+    else{
+        for(i = 0; i < pHash->maxSize; i++){
+                destroyList(pHash->hashList[i], process);
+        }
     }
 
     free(pHash->hashList);
+    free(pHash->chainCounts);
     free(pHash);
 
     return NULL;
@@ -73,16 +238,114 @@ HASH* HASH_Destroy (HASH* pHash,
              -1 - if dup key.
 */
 bool  HASH_Insert(HASH* pHash, void* dataPtr)
+{
+    if(pHash->old){
+        _migrate(pHash, HASH_MIGRATE_STEP);
+        if(pHash->old && _tableRetrieve(pHash->old, dataPtr))
+            return -1;
+    }
+    return _tableInsert(pHash, dataPtr);
+}
+/**	================= HASH_Delete ================
+	   Pre
+	   Post: _return NULL if data not found.
+             _return dataOutPtr if found and the node in the linked-list is deleted.
+*/
+void* HASH_Delete(HASH* pHash, void* dltKey)
+{
+    void *dataOutPtr = NULL;
+
+    if(pHash->old)
+        _migrate(pHash, HASH_MIGRATE_STEP);
+    dataOutPtr = _tableDelete(pHash, dltKey);
+    if(!dataOutPtr && pHash->old)
+        dataOutPtr = _tableDelete(pHash->old, dltKey);
+    return dataOutPtr;
+}
+/**	================= HASH_Retrieve ================
+	   Pre
+	   Post: get the node by the given target
+*/
+void* HASH_Retrieve (HASH* pHash, void* keyPtr)
+{
+    void *dataOutPtr = NULL;
+
+    dataOutPtr = _tableRetrieve(pHash, keyPtr);
+    if(!dataOutPtr && pHash->old)
+        dataOutPtr = _tableRetrieve(pHash->old, keyPtr);
+    return dataOutPtr;
+}
+/**	================= HASH_RetrieveBatch ================
+	   Pre:  keys holds n keys; results has room for n pointers
+	   Post: results[i] is the record matching keys[i], or NULL, as
+             HASH_Retrieve would give. _return the number found.
+             _Each group of keys is hashed and its buckets (HASH_OPEN:
+              home slots, then the record in a slot whose hash matches)
+              prefetched before any of them is probed.
+*/
+int HASH_RetrieveBatch (HASH* pHash, void** keys, void** results, int n)
+{
+    unsigned int hash[HASH_BATCH_GROUP];
+    int bucket[HASH_BATCH_GROUP];
+    int base, i, group, pos;
+    int found = 0;
+
+    for(base = 0; base < n; base += HASH_BATCH_GROUP){
+        group = n - base < HASH_BATCH_GROUP ? n - base : HASH_BATCH_GROUP;
+        for(i = 0; i < group; i++){
+            if(pHash->engine == HASH_OPEN){
+                hash[i] = (unsigned int)pHash->getHashKey(keys[base + i], INT_MAX);
+                bucket[i] = (int)(hash[i] % (unsigned int)pHash->maxSize);
+                PREFETCH(pHash->slots + bucket[i]);
+            }else{
+                bucket[i] = pHash->getHashKey(keys[base + i], pHash->maxSize);
+                PREFETCH(pHash->hashList[bucket[i]]);
+            }
+        }
+        if(pHash->engine == HASH_OPEN){
+            for(i = 0; i < group; i++){
+                if(pHash->slots[bucket[i]].dataPtr && pHash->slots[bucket[i]].hash == hash[i])
+                    PREFETCH(pHash->slots[bucket[i]].dataPtr);
+            }
+        }
+        for(i = 0; i < group; i++){
+            results[base + i] = NULL;
+            if(pHash->engine == HASH_OPEN){
+                if((pos = _openProbe(pHash, keys[base + i], hash[i])) >= 0)
+                    results[base + i] = pHash->slots[pos].dataPtr;
+            }else if(!emptyList(pHash->hashList[bucket[i]]))
+                retrieveNode(pHash->hashList[bucket[i]], keys[base + i], &results[base + i]);
+            if(!results[base + i] && pHash->old)
+                results[base + i] = _tableRetrieve(pHash->old, keys[base + i]);
+            if(results[base + i])
+                found++;
+        }
+    }
+    return found;
+}
+/**	================= _tableInsert ================
+	   Pre
+	   Post: _insert into this table only, ignoring any old table.
+             _return as HASH_Insert.
+*/
+static int _tableInsert(HASH* pHash, void* dataPtr)
 {
     int hashKey = 0;
     int success = 0;  //status  addNode +1 if dupe, -1 if other fail 0 if succest
 
+    // no list (or probe sequence) can grow by more than one per insert
+    if(!_growChainCounts(pHash, pHash->longestList + 1))
+        return 1;
+    if(pHash->engine == HASH_OPEN)
+        return _openInsert(pHash, dataPtr);
+
     //hashKey = getHashKey(dataPtr);
 	hashKey = pHash->getHashKey(dataPtr, pHash->maxSize);  //jw edited from line above
     success = addNode(pHash->hashList[hashKey], dataPtr);
     if(!(success)){ //
         (pHash->count)++;
-        HASH_GetLongestList(pHash);
+        _chainChanged(pHash, listCount(pHash->hashList[hashKey]) - 1,
+                             listCount(pHash->hashList[hashKey]));
          return 0;
     }else if(success == 1)
         return -1;
@@ -91,32 +354,47 @@ bool  HASH_Insert(HASH* pHash, void* dataPtr)
 
 
 }
-/**	================= HASH_Delete ================
+/**	================= _tableDelete ================
 	   Pre
-	   Post: _return NULL if data not found.
-             _return dataOutPtr if found and the node in the linked-list is deleted.
+	   Post: _delete from this table only, ignoring any old table.
 */
-void* HASH_Delete(HASH* pHash, void* dltKey)
+static void* _tableDelete(HASH* pHash, void* dltKey)
 {
     void *dataOutPtr = NULL;
     int hashKey = 0;
+    int pos;
+
+    if(pHash->engine == HASH_OPEN){
+        if((pos = _openFind(pHash, dltKey)) < 0)
+            return NULL;
+        return _openDelete(pHash, pos);
+    }
 
     hashKey = pHash->getHashKey(dltKey, pHash->maxSize);
     if(!(emptyList(pHash->hashList[hashKey]))){
-        if(removeNode(pHash->hashList[hashKey], dltKey, &dataOutPtr))
+        if(removeNode(pHash->hashList[hashKey], dltKey, &dataOutPtr)){
+            (pHash->count)--;
+            _chainChanged(pHash, listCount(pHash->hashList[hashKey]) + 1,
+                                 listCount(pHash->hashList[hashKey]));
             return dataOutPtr;
+        }
     }
-    HASH_GetLongestList(pHash);
     return NULL;
 }
-/**	================= HASH_Retrieve ================
+/**	================= _tableRetrieve ================
 	   Pre
-	   Post: get the node by the given target
+	   Post: _search this table only, ignoring any old table.
 */
-void* HASH_Retrieve (HASH* pHash, void* keyPtr)
+static void* _tableRetrieve (HASH* pHash, void* keyPtr)
 {
     void *dataOutPtr = NULL;
     int hashKey = 0;
+    int pos;
+
+    if(pHash->engine == HASH_OPEN){
+        pos = _openFind(pHash, keyPtr);
+        return pos < 0 ? NULL : pHash->slots[pos].dataPtr;
+    }
 
     hashKey = pHash->getHashKey(keyPtr, pHash->maxSize);
     if(!(emptyList(pHash->hashList[hashKey]))){
@@ -135,10 +413,16 @@ void  HASH_Traverse (HASH* pHash,
 {
     int i;
     for(i = 0; i < pHash->maxSize; i++){
-        if(!emptyList(pHash->hashList[i])){
+        if(pHash->engine == HASH_OPEN){
+            if(pHash->slots[i].dataPtr)
+                process(pHash->slots[i].dataPtr);
+        }
+        else if(!emptyList(pHash->hashList[i])){
            traverseMod(pHash->hashList[i], process);
         }
     }
+    if(pHash->old)
+        HASH_Traverse(pHash->old, process);
     return;
 }
 
@@ -149,7 +433,7 @@ void  HASH_Traverse (HASH* pHash,
 */
 bool HASH_Empty (HASH* pHash)
 {
-    return !(pHash->count);
+    return !HASH_Count(pHash);
 }
 /**	================= HASH_Load ================
 	   Pre
@@ -157,13 +441,7 @@ bool HASH_Empty (HASH* pHash)
 */
 double HASH_Load  (HASH* pHash)
 {
-    int i, cnt;
-    for(i = 0, cnt = 0; i < pHash->maxSize; i++){
-        if(!emptyList(pHash->hashList[i])){
-            cnt++;
-        }
-    }
-    return((double)(cnt)/(double)(pHash->maxSize)) * 100.;
+    return((double)(pHash->nonEmpty)/(double)(pHash->maxSize)) * 100.;
 }
 /**	================= HASH_Count ================
 	   Pre
@@ -171,7 +449,7 @@ double HASH_Load  (HASH* pHash)
 */
 int  HASH_Count (HASH* pHash)
 {
-    return (pHash->count);
+    return pHash->count + (pHash->old ? pHash->old->count : 0);
 }
 
 
@@ -185,11 +463,19 @@ void  HASH_Testing (HASH* pHash,
 {
     int i;
     for(i = 0; i < pHash->maxSize; i++){
-        if(!emptyList(pHash->hashList[i])){
+        if(pHash->engine == HASH_OPEN){
+            if(pHash->slots[i].dataPtr){
+                processIndex(&i);
+                processData(pHash->slots[i].dataPtr);
+            }
+        }
+        else if(!emptyList(pHash->hashList[i])){
 			processIndex(&i);
         	traverseMod(pHash->hashList[i], processData);
 		}
     }
+    if(pHash->old)
+        HASH_Testing(pHash->old, processIndex, processData);
     return;
 }
 
@@ -203,10 +489,27 @@ void  HASH_SaveFile (HASH* pHash,
 {
     FILE *fpOut = NULL;
     fpOut = fopen(fileName, "w");
+    _tableSave(pHash, fpOut, processData);
+    if(pHash->old)
+        _tableSave(pHash->old, fpOut, processData);
+    fclose(fpOut);
+    return;
+}
+/**	=================  _tableSave ================
+	   Pre:  fpOut open for writing
+	   Post: _every record of this table (not its old table) written
+*/
+static void _tableSave (HASH* pHash, FILE* fpOut,
+                        void (*processData)(FILE *fpOut, void* dataPtr))
+{
     NODE *pNode = NULL;
     int i;
     for(i = 0; i < pHash->maxSize; i++){
-        if(!emptyList(pHash->hashList[i])){
+        if(pHash->engine == HASH_OPEN){
+            if(pHash->slots[i].dataPtr)
+                processData(fpOut, pHash->slots[i].dataPtr);
+        }
+        else if(!emptyList(pHash->hashList[i])){
            pNode = pHash->hashList[i]->head;
            while(pNode){
             processData(fpOut, pNode->dataPtr);
@@ -214,26 +517,518 @@ void  HASH_SaveFile (HASH* pHash,
            }
         }
     }
-    fclose(fpOut);
+    return;
+}
+/**	=================  HASH_SaveFileBuffered ================
+	   Pre:  format writes one record's text (no NUL needed) into buf and
+             returns its length; if that is more than size, nothing it
+             wrote is used and it is called again with at least that much
+             room. threads > 1 formats that many bucket ranges at once.
+	   Post: _every record written to fileName in bucket order.
+              _return the number of bytes written, or -1 on failure.
+*/
+long long HASH_SaveFileBuffered (HASH* pHash, char* fileName,
+                                 int (*format)(char* buf, int size, void* dataPtr),
+                                 int threads)
+{
+    SAVE_FILE file;
+    SAVE_PART *parts;
+    pthread_t *tids;
+    bool *started;
+    int buckets = pHash->maxSize + (pHash->old ? pHash->old->maxSize : 0);
+    long long written = 0;
+    int i, j;
+
+    if(!(file.fpOut = fopen(fileName, "w")))
+        return -1;
+    // the parts' buffers are already large, so stdio need not copy them again
+    setvbuf(file.fpOut, NULL, _IONBF, 0);
+    file.turn = 0;
+    pthread_mutex_init(&file.lock, NULL);
+    pthread_cond_init(&file.turned, NULL);
+    if(threads < 1)
+        threads = 1;
+    if(threads > buckets)
+        threads = buckets;
+    parts = calloc(threads, sizeof(SAVE_PART));
+    tids = calloc(threads, sizeof(pthread_t));
+    started = calloc(threads, sizeof(bool));
+    if(!parts || !tids || !started){
+        free(parts), free(tids), free(started);
+        fclose(file.fpOut);
+        return -1;
+    }
+    for(i = 0; i < threads; i++){
+        parts[i].pHash = pHash;
+        parts[i].from = (int)((long long)buckets * i / threads);
+        parts[i].to = (int)((long long)buckets * (i + 1) / threads);
+        parts[i].index = i;
+        parts[i].format = format;
+        parts[i].file = &file;
+        parts[i].failed = !_saveChunk(&parts[i], 0, SAVE_BUFFER_SIZE);
+        parts[i].chunks = 1;
+    }
+    for(i = 1; i < threads; i++)
+        if(!parts[i].failed)
+            started[i] = !pthread_create(&tids[i], NULL, _saveThread, &parts[i]);
+    // in part order, so a part that runs here (or never runs) finds its turn come
+    for(i = 0; i < threads; i++){
+        if(started[i])
+            pthread_join(tids[i], NULL);
+        else if(!parts[i].failed)
+            _saveRange(&parts[i]);
+        else
+            _saveFinish(&parts[i]);
+    }
+    for(i = 0; i < threads; i++){
+        if(parts[i].failed)
+            written = -1;
+        else if(written >= 0)
+            written += parts[i].written;
+        for(j = 0; j < SAVE_CHUNKS; j++)
+            free(parts[i].buf[j]);
+    }
+    if(fclose(file.fpOut))
+        written = -1;
+    pthread_mutex_destroy(&file.lock);
+    pthread_cond_destroy(&file.turned);
+    free(parts), free(tids), free(started);
+    return written;
+}
+/**	=================  _saveThread ================
+	   Pre:  part is a SAVE_PART
+	   Post: _its buckets formatted and written
+*/
+static void* _saveThread(void* part)
+{
+    _saveRange((SAVE_PART*)part);
+    return NULL;
+}
+/**	=================  _saveRange ================
+	   Pre:  part set up by HASH_SaveFileBuffered
+	   Post: _every record in the part's buckets formatted, in bucket order,
+              and written on the part's turn; the turn passed on
+*/
+static void _saveRange(SAVE_PART* part)
+{
+    HASH *pTable;
+    NODE *pNode;
+    int bucket, i;
+
+    for(bucket = part->from; bucket < part->to && !part->failed; bucket++){
+        pTable = part->pHash;
+        i = bucket;
+        if(i >= pTable->maxSize){
+            i -= pTable->maxSize;
+            pTable = pTable->old;
+        }
+        if(pTable->engine == HASH_OPEN){
+            if(pTable->slots[i].dataPtr)
+                _saveRecord(part, pTable->slots[i].dataPtr);
+        }
+        else if(!emptyList(pTable->hashList[i])){
+            for(pNode = pTable->hashList[i]->head; pNode && !part->failed; pNode = pNode->link)
+                _saveRecord(part, pNode->dataPtr);
+        }
+    }
+    _saveFinish(part);
+    return;
+}
+/**	=================  _saveRecord ================
+	   Pre:  part set up by HASH_SaveFileBuffered
+	   Post: _record appended to the part's current buffer. If it doesn't
+              fit, the part moves on to its next buffer, or, once all
+              SAVE_CHUNKS are full (or it is already the part's turn),
+              writes them out, waiting for its turn if need be; a record
+              bigger than an empty buffer gets a bigger buffer.
+              _return false (and mark the part failed) on a write or
+              memory failure.
+*/
+static bool _saveRecord(SAVE_PART* part, void* dataPtr)
+{
+    int cur, need;
+
+    for(;;){
+        cur = part->chunks - 1;
+        need = part->format(part->buf[cur] + part->len[cur], part->cap[cur] - part->len[cur], dataPtr);
+        if(need < 0)
+            return !(part->failed = true);
+        if(need <= part->cap[cur] - part->len[cur])
+            break;
+        if(!part->len[cur]){
+            if(!_saveChunk(part, cur, need))
+                return !(part->failed = true);
+        }else if(part->chunks == SAVE_CHUNKS || _saveTurn(part, false)){
+            if(!_saveFlush(part))
+                return !(part->failed = true);
+        }else{
+            if(!part->buf[cur + 1] && !_saveChunk(part, cur + 1, SAVE_BUFFER_SIZE))
+                return !(part->failed = true);
+            part->chunks++;
+        }
+    }
+    part->len[cur] += need;
+    return true;
+}
+/**	=================  _saveChunk ================
+	   Pre:  chunk < SAVE_CHUNKS
+	   Post: _buf[chunk] replaced by an empty, SAVE_ALIGN aligned buffer of
+              at least size bytes; return false if it can't be allocated
+*/
+static bool _saveChunk(SAVE_PART* part, int chunk, int size)
+{
+    char* buf;
+
+    if(size > INT_MAX - SAVE_ALIGN)
+        return false;
+    size = (size + SAVE_ALIGN - 1) / SAVE_ALIGN * SAVE_ALIGN;
+    if(posix_memalign((void**)&buf, SAVE_ALIGN, size))
+        return false;
+    free(part->buf[chunk]);
+    part->buf[chunk] = buf;
+    part->len[chunk] = 0;
+    part->cap[chunk] = size;
+    return true;
+}
+/**	=================  _saveTurn ================
+	   Pre:  part set up by HASH_SaveFileBuffered
+	   Post: _return whether it is the part's turn to write, first waiting
+              for it if wait is true. Only the part itself passes its turn
+              on, so once true it stays true.
+*/
+static bool _saveTurn(SAVE_PART* part, bool wait)
+{
+    bool mine;
+
+    pthread_mutex_lock(&part->file->lock);
+    while(wait && part->file->turn != part->index)
+        pthread_cond_wait(&part->file->turned, &part->file->lock);
+    mine = part->file->turn == part->index;
+    pthread_mutex_unlock(&part->file->lock);
+    return mine;
+}
+/**	=================  _saveFlush ================
+	   Pre:  part set up by HASH_SaveFileBuffered
+	   Post: _on the part's turn, its full buffers written in order and the
+              first made current again, empty; return false on a write failure
+*/
+static bool _saveFlush(SAVE_PART* part)
+{
+    int i;
+
+    _saveTurn(part, true);
+    for(i = 0; i < part->chunks; i++){
+        if(part->len[i] && fwrite(part->buf[i], 1, part->len[i], part->file->fpOut) != (size_t)part->len[i])
+            return false;
+        part->written += part->len[i];
+        part->len[i] = 0;
+    }
+    part->chunks = 1;
+    return true;
+}
+/**	=================  _saveFinish ================
+	   Pre:  part done formatting (or failed, or never started)
+	   Post: _what it holds written on its turn, unless it failed, and the
+              turn passed to the next part
+*/
+static void _saveFinish(SAVE_PART* part)
+{
+    if(!part->failed && !_saveFlush(part))
+        part->failed = true;
+    _saveTurn(part, true);
+    pthread_mutex_lock(&part->file->lock);
+    part->file->turn++;
+    pthread_cond_broadcast(&part->file->turned);
+    pthread_mutex_unlock(&part->file->lock);
     return;
 }
 /**	=================  HASH_GetLongestList ================
 	   Pre
-	   Post
+	   Post: _return the length of the longest list (kept up to date by insert/delete).
 */
 int HASH_GetLongestList(HASH *pHash)
 {
-    int longestList = 0;
-    int temp = 0;
+    return pHash->longestList;
+}
+/**	=================  HASH_ChainCount ================
+	   Pre
+	   Post: _return the number of buckets whose list holds exactly length records.
+             _length 0 gives the number of empty buckets.
+*/
+int HASH_ChainCount(HASH *pHash, int length)
+{
+    if(length == 0)
+        return pHash->maxSize - pHash->nonEmpty;
+    if(length < 0 || length >= pHash->chainCountsSize)
+        return 0;
+    return pHash->chainCounts[length];
+}
+/**	=================  HASH_SetIntKey ================
+	   Pre:  every record holds an int key offset bytes from its start
+             that is equal exactly when compare returns 0, and keys
+             passed to retrieve/delete carry it too
+	   Post: _the open-addressing engine compares those ints directly
+              instead of calling compare; a negative offset turns this off.
+              The chained engine keeps using compare through its lists.
+*/
+void HASH_SetIntKey(HASH *pHash, int offset)
+{
+    pHash->intKeyOffset = offset;
+    return;
+}
+/**	=================  HASH_GetSlots ================
+	   Pre:  HASH_OPEN table with no rehash in progress; slots has room
+             for maxSize pointers
+	   Post: _slots[i] is the record in slot i, or NULL if it is empty.
+*/
+void HASH_GetSlots(HASH *pHash, void **slots)
+{
     int i;
+
+    for(i = 0; i < pHash->maxSize; i++)
+        slots[i] = pHash->slots[i].dataPtr;
+    return;
+}
+/**	=================  HASH_SetSlots ================
+	   Pre:  empty HASH_OPEN table; slots holds maxSize pointers, as
+             HASH_GetSlots gave them from a table of the same size and
+             getHashKey, with no key twice
+	   Post: _records placed in their slots, with hashes and statistics,
+              and true returned.
+             _false (table still empty) if slots isn't a layout a probe
+              can search: a slot must be empty, and an entry past its
+              home slot must follow one no nearer its own home than the
+              entry was one slot back.
+*/
+bool HASH_SetSlots(HASH *pHash, void **slots)
+{
+    int i, prev, dist, longest = 0, count = 0;
+    bool valid;
+
     for(i = 0; i < pHash->maxSize; i++){
-        if(!emptyList(pHash->hashList[i]))
-            if((temp = listCount(pHash->hashList[i])) > longestList){
-                longestList = temp;
+        pHash->slots[i].dataPtr = slots[i];
+        if(slots[i]){
+            pHash->slots[i].hash = (unsigned int)pHash->getHashKey(slots[i], INT_MAX);
+            count++;
+        }
+    }
+    valid = count < pHash->maxSize;
+    for(i = 0; i < pHash->maxSize && valid; i++){
+        if(!slots[i] || !(dist = _openDistance(pHash, i)))
+            continue;
+        prev = i ? i - 1 : pHash->maxSize - 1;
+        valid = slots[prev] && _openDistance(pHash, prev) >= dist - 1;
+        if(dist > longest)
+            longest = dist;
+    }
+    if(!valid || !_growChainCounts(pHash, longest + 1)){
+        memset(pHash->slots, 0, pHash->maxSize * sizeof(HASH_SLOT));
+        return false;
+    }
+    for(i = 0; i < pHash->maxSize; i++)
+        if(slots[i])
+            _chainChanged(pHash, 0, _openDistance(pHash, i) + 1);
+    pHash->count = count;
+    return true;
+}
+/**	=================  _keyCompare ================
+	   Pre
+	   Post: _return 0 if the two records have the same key, as compare would.
+*/
+static int _keyCompare(HASH* pHash, void* argu1, void* argu2)
+{
+    if(pHash->intKeyOffset < 0)
+        return pHash->compare(argu1, argu2);
+    return *(int *)((char *)argu1 + pHash->intKeyOffset)
+        != *(int *)((char *)argu2 + pHash->intKeyOffset);
+}
+/**	=================  _growChainCounts ================
+	   Pre
+	   Post: _make room in the chain-length histogram for lists of the given length.
+             _return false if memory could not be allocated.
+*/
+static bool _growChainCounts(HASH* pHash, int length)
+{
+    int *temp;
+    int newSize = pHash->chainCountsSize ? pHash->chainCountsSize : CHAIN_COUNTS_START;
+    int i;
+
+    if(length < pHash->chainCountsSize)
+        return true;
+    while(newSize <= length)
+        newSize *= 2;
+    temp = (int *)realloc(pHash->chainCounts, newSize * sizeof(int));
+    if(!temp)
+        return false;
+    for(i = pHash->chainCountsSize; i < newSize; i++)
+        temp[i] = 0;
+    pHash->chainCounts = temp;
+    pHash->chainCountsSize = newSize;
+    return true;
+}
+/**	=================  _chainChanged ================
+	   Pre:  a bucket's list has just grown or shrunk from oldLength to newLength records.
+	   Post: _non-empty count, histogram and longest list updated.
+*/
+static void _chainChanged(HASH* pHash, int oldLength, int newLength)
+{
+    if(oldLength)
+        (pHash->chainCounts[oldLength])--;
+    else
+        (pHash->nonEmpty)++;
+    if(newLength)
+        (pHash->chainCounts[newLength])++;
+    else
+        (pHash->nonEmpty)--;
+
+    if(newLength > pHash->longestList)
+        pHash->longestList = newLength;
+    else while(pHash->longestList > 0 && !pHash->chainCounts[pHash->longestList])
+        (pHash->longestList)--;
+    return;
+}
+/**	=================  _openDistance ================
+	   Pre:  slot pos is occupied (HASH_OPEN)
+	   Post: _return how many slots the entry sits past its home slot.
+*/
+static int _openDistance(HASH* pHash, int pos)
+{
+    int home = (int)(pHash->slots[pos].hash % (unsigned int)pHash->maxSize);
+    return pos >= home ? pos - home : pos + pHash->maxSize - home;
+}
+/**	=================  _openInsert ================
+	   Pre:  HASH_OPEN table; histogram has room for longestList + 1
+	   Post: 0  - successful.
+             1  - failed (table full).
+             -1 - if dup key.
+             _Walks from the home slot. Until the first displacement the
+              key may still be in the table, so matching hashes are
+              compared; once an entry nearer its home is met the key is
+              known to be absent, and the carried entry swaps places with
+              it and continues (Robin Hood).
+*/
+static int _openInsert(HASH* pHash, void* dataPtr)
+{
+    HASH_SLOT carry, temp;
+    int pos, dist = 0, slotDist;
+    bool displaced = false;
+
+    if(pHash->count >= pHash->maxSize)
+        return 1;
+    carry.dataPtr = dataPtr;
+    carry.hash = (unsigned int)pHash->getHashKey(dataPtr, INT_MAX);
+    pos = (int)(carry.hash % (unsigned int)pHash->maxSize);
+
+    while(pHash->slots[pos].dataPtr){
+        slotDist = _openDistance(pHash, pos);
+        if(!displaced && pHash->slots[pos].hash == carry.hash
+                      && !_keyCompare(pHash, dataPtr, pHash->slots[pos].dataPtr))
+            return -1;
+        if(slotDist < dist){
+            temp = pHash->slots[pos];
+            pHash->slots[pos] = carry;
+            _chainChanged(pHash, 0, dist + 1);
+            _chainChanged(pHash, slotDist + 1, 0);
+            carry = temp;
+            dist = slotDist;
+            displaced = true;
         }
+        if(++pos == pHash->maxSize)
+            pos = 0;
+        dist++;
     }
+    pHash->slots[pos] = carry;
+    _chainChanged(pHash, 0, dist + 1);
+    (pHash->count)++;
+    return 0;
+}
+/**	=================  _openFind ================
+	   Pre:  HASH_OPEN table
+	   Post: _return slot holding the record matching keyPtr, or -1.
+*/
+static int _openFind(HASH* pHash, void* keyPtr)
+{
+    return _openProbe(pHash, keyPtr, (unsigned int)pHash->getHashKey(keyPtr, INT_MAX));
+}
+/**	=================  _openProbe ================
+	   Pre:  HASH_OPEN table; hash is getHashKey(keyPtr, INT_MAX)
+	   Post: _return slot holding the record matching keyPtr, or -1.
+*/
+static int _openProbe(HASH* pHash, void* keyPtr, unsigned int hash)
+{
+    int pos = (int)(hash % (unsigned int)pHash->maxSize);
+    int dist = 0;
 
-    return pHash->longestList = longestList;
+    while(pHash->slots[pos].dataPtr && _openDistance(pHash, pos) >= dist){
+        if(pHash->slots[pos].hash == hash && !_keyCompare(pHash, keyPtr, pHash->slots[pos].dataPtr))
+            return pos;
+        if(++pos == pHash->maxSize)
+            pos = 0;
+        dist++;
+    }
+    return -1;
+}
+/**	=================  _openDelete ================
+	   Pre:  HASH_OPEN table; slot pos is occupied
+	   Post: _record removed and returned; following entries that are
+              not in their home slot are shifted back one slot.
+*/
+static void* _openDelete(HASH* pHash, int pos)
+{
+    void *dataOutPtr = pHash->slots[pos].dataPtr;
+    int next, dist;
+
+    _chainChanged(pHash, _openDistance(pHash, pos) + 1, 0);
+    next = pos + 1 == pHash->maxSize ? 0 : pos + 1;
+    while(pHash->slots[next].dataPtr && (dist = _openDistance(pHash, next)) > 0){
+        pHash->slots[pos] = pHash->slots[next];
+        _chainChanged(pHash, dist + 1, dist);
+        pos = next;
+        next = pos + 1 == pHash->maxSize ? 0 : pos + 1;
+    }
+    pHash->slots[pos].dataPtr = NULL;
+    (pHash->count)--;
+    return dataOutPtr;
+}
+/**	=================  _migrate ================
+	   Pre:  pHash->old is not NULL
+	   Post: _up to buckets buckets of the old table moved into pHash; the
+              old table is destroyed once its last bucket is empty.
+              _A backward-shift delete in an open table only pulls entries
+              toward the emptied slot, so draining slot i until it is empty
+              never refills slots below i.
+*/
+static void _migrate(HASH* pHash, int buckets)
+{
+    HASH *old = pHash->old;
+    void *dataPtr;
+
+    while(buckets-- > 0 && pHash->migrateNext < old->maxSize){
+        for(;;){
+            if(old->engine == HASH_OPEN){
+                if(!old->slots[pHash->migrateNext].dataPtr)
+                    break;
+                dataPtr = _openDelete(old, pHash->migrateNext);
+            }
+            else{
+                if(emptyList(old->hashList[pHash->migrateNext]))
+                    break;
+                dataPtr = _tableDelete(old, old->hashList[pHash->migrateNext]->head->dataPtr);
+            }
+            if(_tableInsert(pHash, dataPtr)){
+                // out of memory: leave the record where it was and try again later
+                _tableInsert(old, dataPtr);
+                return;
+            }
+        }
+        (pHash->migrateNext)++;
+    }
+    if(pHash->migrateNext == old->maxSize){
+        HASH_Destroy(old, NULL);
+        pHash->old = NULL;
+        pHash->migrateNext = 0;
+    }
+    return;
 }
 
 
@@ -258,12 +1053,23 @@ void HASH_ReHash (HASH** pHash, int (*getPrime)(int))
 {
 	HASH* tHash;
 	void* dataPtr;
-	int i, hashSize = getPrime((*pHash)->maxSize * 2);  //TODO next prime
+	int i, hashSize;
+
+	if ((*pHash)->old)
+		_migrate(*pHash, INT_MAX);
+	hashSize = getPrime((*pHash)->maxSize * 2);  //TODO next prime
 
-	tHash = HASH_Create((*pHash)->getHashKey, (*pHash)->compare, hashSize);
+	tHash = HASH_CreateEngine((*pHash)->getHashKey, (*pHash)->compare, hashSize, (*pHash)->engine);
+	tHash->intKeyOffset = (*pHash)->intKeyOffset;
 
 	for (i = 0; i < (*pHash)->maxSize; i++)
 	{
+		if ((*pHash)->engine == HASH_OPEN)
+		{
+			if ((*pHash)->slots[i].dataPtr)
+				HASH_Insert(tHash, (*pHash)->slots[i].dataPtr);
+			continue;
+		}
 		while (!emptyList((*pHash)->hashList[i]))
 		{
 			//	dataPtr      -> data to be popped off and put in new hashlist
@@ -276,6 +1082,32 @@ void HASH_ReHash (HASH** pHash, int (*getPrime)(int))
 	return;
 }
 
+/****************************************************************
+ * Same as HASH_ReHash, but the records are not moved here: the new
+ * table keeps the old one and later inserts and deletes move a few
+ * buckets at a time. A migration still in progress is finished first.
+ *
+ * Pre: hash populated
+ * Post: new hash allocated and linked to the old one; if it cannot be
+ * allocated the hash is left as it was
+ * ***********************************************************/
+
+void HASH_ReHashIncremental (HASH** pHash, int (*getPrime)(int))
+{
+	HASH* tHash;
+
+	if ((*pHash)->old)
+		_migrate(*pHash, INT_MAX);
+	tHash = HASH_CreateEngine((*pHash)->getHashKey, (*pHash)->compare,
+	                          getPrime((*pHash)->maxSize * 2), (*pHash)->engine);
+	if (!tHash)
+		return;
+	tHash->intKeyOffset = (*pHash)->intKeyOffset;
+	tHash->old = *pHash;
+	*pHash = tHash;
+	return;
+}
+
 
 
 
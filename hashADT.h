@@ -16,14 +16,37 @@
 
 typedef enum { false, true} bool;
 
+// HASH_CHAINED: each bucket is a sorted LIST (the original engine)
+// HASH_OPEN:    Robin Hood open addressing in a flat array of slots
+typedef enum { HASH_CHAINED, HASH_OPEN } HASH_ENGINE;
+
 typedef struct
 {
+	 void*        dataPtr;   // NULL if the slot is empty
+	 unsigned int hash;      // full hash of the record, checked before dataPtr is touched
+}HASH_SLOT;
+
+// buckets moved from the old table by each insert or delete while an
+// incremental rehash is in progress
+#define HASH_MIGRATE_STEP 8
+
+typedef struct hashTable
+{
+	 HASH_ENGINE engine;
 	 int   count;
 	 int maxSize;
 	 int  (*compare)(void* argu1, void* argu2);
 	 int (*getHashKey)(void* argu1, int hashSize);
-	 LIST**  hashList;
+	 int intKeyOffset;      // >= 0: records hold an int key here (HASH_SetIntKey)
+	 LIST**  hashList;      // HASH_CHAINED only
+	 HASH_SLOT* slots;      // HASH_OPEN only
 	 int longestList;
+	 int nonEmpty;          // buckets holding at least one record
+	 int* chainCounts;      // chainCounts[n] = buckets whose list holds n records
+	                        //   (HASH_OPEN: records found on the n-th probe)
+	 int chainCountsSize;
+	 struct hashTable* old; // table still being drained by an incremental rehash, or NULL
+	 int migrateNext;       // next bucket of old to move
 }HASH;
 
 //	Prototype Declarations for public functions
@@ -44,12 +67,19 @@ typedef struct
               int (*compare) (void* argu1, void* argu2),
               int maxSize);                            //testing
 
+	HASH* HASH_CreateEngine
+	         (int (*getHashKey)(void* argu1, int hashSize),
+              int (*compare) (void* argu1, void* argu2),
+              int maxSize,
+              HASH_ENGINE engine);
+
 	HASH* HASH_Destroy (HASH* pHash,
                         void (*process)(void **dataOut));     //added 05/24 @2.54 PM
 
 	bool  HASH_Insert   (HASH* pHash, void* dataPtr);
 	void* HASH_Delete   (HASH* pHash, void* dltKey);
 	void* HASH_Retrieve (HASH* pHash, void* keyPtr);
+	int   HASH_RetrieveBatch (HASH* pHash, void** keys, void** results, int n);
 	void  HASH_Traverse (HASH* pHash,
 	          //          void (*process)(void* dataPtr, int index)); CHANGE JW removed index
 			 		 	void (*process)(void* dataPtr));
@@ -66,8 +96,17 @@ typedef struct
 				  char *fileName,
                   void (*processData)(FILE *fpOut, void* dataPtr));
 
+    long long HASH_SaveFileBuffered (HASH* pHash, char* fileName,
+                  int (*format)(char* buf, int size, void* dataPtr),
+                  int threads);
+
     int HASH_GetLongestList(HASH *pHash);
+    int HASH_ChainCount(HASH *pHash, int length);
+    void HASH_SetIntKey(HASH *pHash, int offset);
+    void HASH_GetSlots(HASH *pHash, void **slots);
+    bool HASH_SetSlots(HASH *pHash, void **slots);
 /***********************  BRENDA's ***************************************/
 
 void HASH_ReHash (HASH** pHash, int (*getPrime)(int));
+void HASH_ReHashIncremental (HASH** pHash, int (*getPrime)(int));
 	//	void (*process)(void* dataPtr));
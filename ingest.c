@@ -0,0 +1,538 @@
+#include <unistd.h>
+#include "team.h"
+
+/************************************************************************************
+ * Parallel loading of a text input file.
+ *
+ * The file is split into parts (splitInput) and each part is read by a
+ * parse thread of its own. Parsed records go on in batches over a bounded
+ * channel, so parsing never runs more than INGEST_QUEUE batches ahead of
+ * whatever takes them:
+ *
+ *   parse x N --batches--> consume
+ *
+ * For setup the consumer is the hash stage, which feeds two tree stages:
+ *
+ *   parse x N --> hash --runs--> id tree
+ *                          \---> name tree
+ *
+ * The hash stage is the only thread that touches the hash. It rejects a
+ * duplicate id just as addPrisoner does, so the trees only ever see
+ * accepted records. These are passed on in runs of INGEST_RUN; each tree
+ * stage sorts the runs as they come, while parsing goes on, and merges them
+ * once the input is done to build its tree with BuildTreeSorted.
+ *
+ * So that a file always loads the same way, whatever order the parts are
+ * read in, records with the same name are sorted by id, and of records
+ * sharing an id the first in the file is kept. Every record comes with its
+ * offset in the file; should a later copy reach the hash stage first, it is
+ * evicted when the earlier one arrives, and the tree stages drop it before
+ * merging. A consumer that can't take a record back asks for the parts in
+ * order instead, at the cost of later parts waiting on a full channel until
+ * their turn.
+ **************************************************************************************/
+
+#define INGEST_BATCH	1024			// records handed over at a time
+#define INGEST_QUEUE	64				// batches a channel holds before senders wait
+#define INGEST_RUN		(64 * 1024)		// accepted records a tree stage sorts at a time
+#define INGEST_PARSERS	16
+#define INGEST_MIN_PART	(1 << 20)		// bytes worth a parse thread of its own
+
+typedef struct{
+	QUEUE* queue;
+	int producers;						// senders not done yet
+	pthread_mutex_t lock;
+	pthread_cond_t notEmpty;
+	pthread_cond_t notFull;
+}CHANNEL;
+
+typedef struct{
+	PRISONER** records;
+	long long* offsets;					// where each record ends in the file, or NULL
+	int count;
+}BATCH;
+
+typedef struct{
+	INPUT* part;
+	CHANNEL* out;
+}PARSE_STAGE;
+
+typedef struct{
+	CHANNEL runs;
+	TREE* tree;
+	int (*compare)(const void* arg1, const void* arg2);
+	BATCH* sorted;						// runs received, each sorted
+	int numRuns;
+	int total;
+	PRISONER** evicted;					// set before runs is done; sorted by address
+	int numEvicted;
+	int success;
+	pthread_t thread;
+}TREE_STAGE;
+
+typedef struct{
+	PRISONER** records;					// open addressing on the record's address
+	long long* offsets;
+	size_t size;						// a power of two
+	size_t count;
+}OFFSETS;
+
+typedef struct{
+	HASH** hash;
+	PRISONER** run;
+	int count;
+	OFFSETS offsets;					// of every record the hash has taken
+	PRISONER** evicted;
+	int numEvicted;
+	int maxEvicted;
+	TREE_STAGE ids;
+	TREE_STAGE names;
+}HASH_STAGE;
+
+static void channelInit(CHANNEL* channel, int producers);
+static void channelSend(CHANNEL* channel, PRISONER** records, long long* offsets, int count);
+static int channelReceive(CHANNEL* channel, BATCH* batch);
+static void channelDone(CHANNEL* channel);
+static void channelDestroy(CHANNEL* channel);
+static void* parseStage(void* arg);
+static void hashStage(PRISONER** records, long long* offsets, int count, void* arg);
+static void evict(HASH_STAGE* stage, PRISONER* prisoner);
+static void passRun(HASH_STAGE* stage);
+static long long* offsetSlot(OFFSETS* table, PRISONER* prisoner);
+static void* treeStage(void* arg);
+static int compareNameThenId(const void* arg1, const void* arg2);
+static int compareAddress(const void* arg1, const void* arg2);
+static PRISONER** mergeRuns(BATCH* runs, int numRuns, int total, int (*compare)(const void* arg1, const void* arg2));
+
+/* ============== ingestFile ================
+ * Reads in with one parse thread per INGEST_MIN_PART bytes, up to the
+ * number of processors online (at most INGEST_PARSERS), and hands every
+ * record to consume, a batch at a time, on the calling thread, along with
+ * the offset in the file where each record ends.
+ * Pre: in open and not yet read; ordered set if consume must see the
+ *      records in file order
+ * Post: every record passed to consume, which owns it from then on;
+ *       in->records set to the number read
+ */
+void ingestFile(INPUT* in, void (*consume)(PRISONER** records, long long* offsets, int count, void* arg),
+		void* arg, int ordered)
+{
+	INPUT* parts[INGEST_PARSERS];
+	PARSE_STAGE stages[INGEST_PARSERS];
+	pthread_t threads[INGEST_PARSERS];
+	CHANNEL channels[INGEST_PARSERS];
+	BATCH batch;
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	int n = (int)(in->size / INGEST_MIN_PART), i, numChannels;
+
+	if (n > cpus)
+		n = (int)cpus;
+	if (n > INGEST_PARSERS)
+		n = INGEST_PARSERS;
+	if (n < 1)
+		n = 1;
+	splitInput(in, parts, n);
+	// in order, each part has a channel of its own, drained one after the other
+	numChannels = ordered ? n : 1;
+	for (i = 0; i < numChannels; i++)
+		channelInit(&channels[i], ordered ? 1 : n);
+	for (i = 0; i < n; i++) {
+		stages[i].part = parts[i];
+		stages[i].out = &channels[ordered ? i : 0];
+		if (pthread_create(&threads[i], NULL, parseStage, &stages[i]))
+			printf("\nparse thread wouldn't start\n"), exit(100);
+	}
+	for (i = 0; i < numChannels; i++)
+		while (channelReceive(&channels[i], &batch)) {
+			consume(batch.records, batch.offsets, batch.count, arg);
+			free(batch.records);
+			free(batch.offsets);
+		}
+	in->records = 0;
+	for (i = 0; i < n; i++) {
+		pthread_join(threads[i], NULL);
+		in->records += parts[i]->records;
+		closeInput(parts[i]);
+	}
+	for (i = 0; i < numChannels; i++)
+		channelDestroy(&channels[i]);
+}
+
+/* ============== ingestIndexes ================
+ * Pre: in open and not yet read; hash and both trees created and empty
+ * Post: every record of in with a new id in the hash and both trees,
+ *       the rest reported and freed; return 0 if a tree couldn't be built
+ */
+int ingestIndexes(INPUT* in, HASH** hash, TREE* nameTree, TREE* idTree)
+{
+	HASH_STAGE stage;
+	int i;
+
+	memset(&stage, 0, sizeof(stage));
+	stage.hash = hash;
+	stage.run = xMalloc(INGEST_RUN * sizeof(PRISONER*));
+	stage.ids.tree = idTree;
+	stage.ids.compare = sortCompareId;
+	stage.names.tree = nameTree;
+	stage.names.compare = compareNameThenId;
+	stage.offsets.size = 1024;
+	stage.offsets.records = calloc(stage.offsets.size, sizeof(PRISONER*));
+	stage.offsets.offsets = xMalloc(stage.offsets.size * sizeof(long long));
+	if (!stage.offsets.records)
+		printf("\nout of memory\n"), exit(100);
+	channelInit(&stage.ids.runs, 1);
+	channelInit(&stage.names.runs, 1);
+	if (pthread_create(&stage.ids.thread, NULL, treeStage, &stage.ids)
+			|| pthread_create(&stage.names.thread, NULL, treeStage, &stage.names))
+		printf("\ntree thread wouldn't start\n"), exit(100);
+
+	ingestFile(in, hashStage, &stage, 0);
+	passRun(&stage);
+	free(stage.run);
+	free(stage.offsets.records);
+	free(stage.offsets.offsets);
+	// the trees read the evicted list only once their channel says done
+	if (stage.numEvicted)
+		qsort(stage.evicted, stage.numEvicted, sizeof(PRISONER*), compareAddress);
+	stage.ids.evicted = stage.names.evicted = stage.evicted;
+	stage.ids.numEvicted = stage.names.numEvicted = stage.numEvicted;
+	channelDone(&stage.ids.runs);
+	channelDone(&stage.names.runs);
+	pthread_join(stage.ids.thread, NULL);
+	pthread_join(stage.names.thread, NULL);
+	channelDestroy(&stage.ids.runs);
+	channelDestroy(&stage.names.runs);
+	for (i = 0; i < stage.numEvicted; i++)
+		freePrisoner(stage.evicted[i]);
+	free(stage.evicted);
+	return stage.ids.success && stage.names.success;
+}
+
+/* ============== hashStage ================
+ * Pre: records is a batch from the parse stages, offsets where each ends
+ *      in the file; arg the HASH_STAGE
+ * Post: records with a new id hashed and queued for the trees; of records
+ *       sharing an id the one first in the file kept, the others reported
+ *       and freed or evicted
+ */
+static void hashStage(PRISONER** records, long long* offsets, int count, void* arg)
+{
+	HASH_STAGE* stage = arg;
+	PRISONER* kept;
+	long long* offset;
+	int i, hashStatus;
+
+	for (i = 0; i < count; i++) {
+		hashStatus = HASH_Insert(*stage->hash, records[i]);
+		if (hashStatus == -1) {
+			kept = HASH_Retrieve(*stage->hash, records[i]);
+			if (*offsetSlot(&stage->offsets, kept) > offsets[i]) {
+				// a later copy got here first; this one takes its place
+				HASH_Delete(*stage->hash, kept);
+				hashStatus = HASH_Insert(*stage->hash, records[i]);
+				evict(stage, kept);
+			}
+		}
+		if (hashStatus) {
+			if (hashStatus == -1) printf("%s a duplicate id, unique id's are required.\n", records[i]->id);
+			printf("\nerror inserting:\n");
+			printPrisoner(records[i]);
+			freePrisoner(records[i]);
+			continue;
+		}
+		offset = offsetSlot(&stage->offsets, records[i]);
+		*offset = offsets[i];
+		stage->run[stage->count++] = records[i];
+		if (stage->count == INGEST_RUN)
+			passRun(stage);
+		if (HASH_Load(*stage->hash) >= 75)
+			HASH_ReHash(stage->hash, getPrime);
+	}
+}
+
+/* ============== evict ================
+ * Pre: prisoner already sent to or queued for the trees, and just taken out
+ *      of the hash for an earlier copy of its id
+ * Post: prisoner reported and listed for the tree stages to drop; it is
+ *       freed once they have
+ */
+static void evict(HASH_STAGE* stage, PRISONER* prisoner)
+{
+	printf("%s a duplicate id, unique id's are required.\n", prisoner->id);
+	printf("\nerror inserting:\n");
+	printPrisoner(prisoner);
+	if (stage->numEvicted == stage->maxEvicted) {
+		stage->maxEvicted = stage->maxEvicted ? stage->maxEvicted * 2 : 16;
+		stage->evicted = realloc(stage->evicted, stage->maxEvicted * sizeof(PRISONER*));
+		if (!stage->evicted)
+			printf("\nout of memory\n"), exit(100);
+	}
+	stage->evicted[stage->numEvicted++] = prisoner;
+}
+
+/* ============== passRun ================
+ * Pre: stage->count records accepted since the last run
+ * Post: they are sent to both tree stages and a new run started
+ */
+static void passRun(HASH_STAGE* stage)
+{
+	if (!stage->count)
+		return;
+	channelSend(&stage->ids.runs, stage->run, NULL, stage->count);
+	channelSend(&stage->names.runs, stage->run, NULL, stage->count);
+	stage->count = 0;
+}
+
+/* ============== offsetSlot ================
+ * The table doubles once half full, so a probe always ends.
+ * Pre: table initialised with a power of two size
+ * Post: return where prisoner's offset is kept, the slot taken for it if
+ *       it had none
+ */
+static long long* offsetSlot(OFFSETS* table, PRISONER* prisoner)
+{
+	PRISONER** oldRecords;
+	long long* oldOffsets;
+	size_t oldSize, i, mask = table->size - 1;
+
+	i = ((size_t)prisoner >> 4) * 0x9E3779B97F4A7C15ULL & mask;
+	while (table->records[i] && table->records[i] != prisoner)
+		i = (i + 1) & mask;
+	if (table->records[i])
+		return &table->offsets[i];
+	if ((table->count + 1) * 2 > table->size) {
+		oldRecords = table->records;
+		oldOffsets = table->offsets;
+		oldSize = table->size;
+		table->size *= 2;
+		table->count = 0;
+		table->records = calloc(table->size, sizeof(PRISONER*));
+		table->offsets = xMalloc(table->size * sizeof(long long));
+		if (!table->records)
+			printf("\nout of memory\n"), exit(100);
+		for (i = 0; i < oldSize; i++)
+			if (oldRecords[i])
+				*offsetSlot(table, oldRecords[i]) = oldOffsets[i];
+		free(oldRecords);
+		free(oldOffsets);
+		return offsetSlot(table, prisoner);
+	}
+	table->records[i] = prisoner;
+	table->count++;
+	return &table->offsets[i];
+}
+
+/* ============== parseStage ================
+ * Pre: arg a PARSE_STAGE with an unread part
+ * Post: every record of the part sent in batches; the channel told this
+ *       sender is done
+ */
+static void* parseStage(void* arg)
+{
+	PARSE_STAGE* stage = arg;
+	PRISONER* batch[INGEST_BATCH];
+	long long offsets[INGEST_BATCH];
+	int count = 0;
+
+	while ((batch[count] = nextPrisoner(stage->part))) {
+		offsets[count] = stage->part->pos - stage->part->map;
+		if (++count == INGEST_BATCH) {
+			channelSend(stage->out, batch, offsets, count);
+			count = 0;
+		}
+	}
+	if (count)
+		channelSend(stage->out, batch, offsets, count);
+	channelDone(stage->out);
+	return NULL;
+}
+
+/* ============== treeStage ================
+ * Pre: arg a TREE_STAGE whose tree is empty
+ * Post: every run sorted as it arrives; once the hash stage is done the runs
+ *       are merged, the evicted records dropped and the tree built;
+ *       success set
+ */
+static void* treeStage(void* arg)
+{
+	TREE_STAGE* stage = arg;
+	BATCH run;
+	PRISONER** all;
+	int size = 0, i, kept = 0;
+
+	while (channelReceive(&stage->runs, &run)) {
+		qsort(run.records, run.count, sizeof(PRISONER*), stage->compare);
+		if (stage->numRuns == size) {
+			size = size ? size * 2 : 16;
+			stage->sorted = realloc(stage->sorted, size * sizeof(BATCH));
+			if (!stage->sorted)
+				printf("\nout of memory\n"), exit(100);
+		}
+		stage->sorted[stage->numRuns++] = run;
+		stage->total += run.count;
+	}
+	all = mergeRuns(stage->sorted, stage->numRuns, stage->total, stage->compare);
+	free(stage->sorted);
+	if (stage->numEvicted) {
+		for (i = 0; i < stage->total; i++)
+			if (!bsearch(&all[i], stage->evicted, stage->numEvicted, sizeof(PRISONER*), compareAddress))
+				all[kept++] = all[i];
+		stage->total = kept;
+	}
+	stage->success = BuildTreeSorted(stage->tree, (void**)all, stage->total);
+	free(all);
+	return NULL;
+}
+
+/* ============== compareNameThenId ================
+ * Ties between equal names go by id, so the name tree comes out the same
+ * whatever order the runs arrived in.
+ * Pre: arg1 and arg2 point to record pointers
+ * Post: return their order by name, then by id
+ */
+static int compareNameThenId(const void* arg1, const void* arg2)
+{
+	int result = sortCompareName(arg1, arg2);
+
+	return result ? result : sortCompareId(arg1, arg2);
+}
+
+/* ============== compareAddress ================
+ * Pre: arg1 and arg2 point to record pointers
+ * Post: return their order by address
+ */
+static int compareAddress(const void* arg1, const void* arg2)
+{
+	const PRISONER* a = *(PRISONER* const*)arg1;
+	const PRISONER* b = *(PRISONER* const*)arg2;
+
+	return (a > b) - (a < b);
+}
+
+/* ============== mergeRuns ================
+ * Adjacent runs are merged pairwise, a pass at a time, between two arrays.
+ * Pre: runs each sorted by compare, total records between them
+ * Post: return all records in one sorted array; the runs are freed
+ */
+static PRISONER** mergeRuns(BATCH* runs, int numRuns, int total, int (*compare)(const void* arg1, const void* arg2))
+{
+	PRISONER **from = xMalloc((total + 1) * sizeof(PRISONER*));
+	PRISONER **to = xMalloc((total + 1) * sizeof(PRISONER*));
+	PRISONER **swap;
+	int* bounds = xMalloc((numRuns + 1) * sizeof(int));
+	int i, a, mid, b, end, pos = 0;
+
+	for (i = 0; i < numRuns; i++) {
+		bounds[i] = pos;
+		memcpy(from + pos, runs[i].records, runs[i].count * sizeof(PRISONER*));
+		pos += runs[i].count;
+		free(runs[i].records);
+	}
+	bounds[numRuns] = total;
+	while (numRuns > 1) {
+		for (i = 0; i < numRuns; i += 2) {
+			a = pos = bounds[i];
+			b = mid = bounds[i + 1];
+			end = bounds[i + 2 <= numRuns ? i + 2 : numRuns];
+			while (a < mid && b < end)
+				to[pos++] = compare(&from[b], &from[a]) < 0 ? from[b++] : from[a++];
+			while (a < mid)
+				to[pos++] = from[a++];
+			while (b < end)
+				to[pos++] = from[b++];
+			bounds[i / 2] = bounds[i];
+		}
+		numRuns = (numRuns + 1) / 2;
+		bounds[numRuns] = total;
+		swap = from, from = to, to = swap;
+	}
+	free(bounds);
+	free(to);
+	return from;
+}
+
+/* ============== channelInit ================
+ * Pre: producers is the number of threads that will send
+ * Post: channel empty and ready
+ */
+static void channelInit(CHANNEL* channel, int producers)
+{
+	if (!(channel->queue = createQueue()))
+		printf("\nout of memory\n"), exit(100);
+	channel->producers = producers;
+	pthread_mutex_init(&channel->lock, NULL);
+	pthread_cond_init(&channel->notEmpty, NULL);
+	pthread_cond_init(&channel->notFull, NULL);
+}
+
+/* ============== channelSend ================
+ * Pre: records holds count records; offsets as many offsets, or is NULL
+ * Post: a copy of them queued, after waiting while INGEST_QUEUE batches are
+ */
+static void channelSend(CHANNEL* channel, PRISONER** records, long long* offsets, int count)
+{
+	BATCH* batch = xMalloc(sizeof(BATCH));
+
+	batch->records = xMalloc(count * sizeof(PRISONER*));
+	memcpy(batch->records, records, count * sizeof(PRISONER*));
+	batch->offsets = NULL;
+	if (offsets) {
+		batch->offsets = xMalloc(count * sizeof(long long));
+		memcpy(batch->offsets, offsets, count * sizeof(long long));
+	}
+	batch->count = count;
+	pthread_mutex_lock(&channel->lock);
+	while (queueCount(channel->queue) >= INGEST_QUEUE)
+		pthread_cond_wait(&channel->notFull, &channel->lock);
+	if (!enqueue(channel->queue, batch))
+		printf("\nout of memory\n"), exit(100);
+	pthread_cond_signal(&channel->notEmpty);
+	pthread_mutex_unlock(&channel->lock);
+}
+
+/* ============== channelReceive ================
+ * Pre: channel initialised
+ * Post: return 1 with the oldest batch in *batch (its arrays now the
+ *       caller's to free), or 0 once every sender is done and nothing is left
+ */
+static int channelReceive(CHANNEL* channel, BATCH* batch)
+{
+	void* item;
+
+	pthread_mutex_lock(&channel->lock);
+	while (emptyQueue(channel->queue) && channel->producers)
+		pthread_cond_wait(&channel->notEmpty, &channel->lock);
+	if (!dequeue(channel->queue, &item)) {
+		pthread_mutex_unlock(&channel->lock);
+		return 0;
+	}
+	pthread_cond_signal(&channel->notFull);
+	pthread_mutex_unlock(&channel->lock);
+	*batch = *(BATCH*)item;
+	free(item);
+	return 1;
+}
+
+/* ============== channelDone ================
+ * Pre: called once by each sender when it has sent everything
+ * Post: the receiver woken if this was the last sender
+ */
+static void channelDone(CHANNEL* channel)
+{
+	pthread_mutex_lock(&channel->lock);
+	if (!--channel->producers)
+		pthread_cond_broadcast(&channel->notEmpty);
+	pthread_mutex_unlock(&channel->lock);
+}
+
+/* ============== channelDestroy ================
+ * Pre: every sender done and everything received
+ * Post: channel released
+ */
+static void channelDestroy(CHANNEL* channel)
+{
+	destroyQueue(channel->queue);
+	pthread_mutex_destroy(&channel->lock);
+	pthread_cond_destroy(&channel->notEmpty);
+	pthread_cond_destroy(&channel->notFull);
+}
@@ -19,69 +19,84 @@
 /********************** input file processing ****************************************/
 
 /******************************************************
- *  opens/closes main inputfile
+ *  opens/closes main inputfile (text, or a binary snapshot)
  *  creates and populates hash, nameTree, and idTree
  *  exits on fatal failures with error messages
  *  ************************************************/
 void setup(HASH** hash, TREE** nameTree, TREE** idTree, char* inFile)
 {
-	char buff[256];
-	PRISONER *prisoner; 
-
-	FILE* fp = fopen(inFile, "r");
-	if(!fp){
-		printf("\nerror opening input\n");
-		exit(100);
+	int numLines, hashSize;
+	SNAPSHOT* snap = NULL;
+	INPUT* in = NULL;
+
+	if(isSnapshot(inFile)){
+		if(!(snap = openSnapshot(inFile))) exit(100);
+		numLines = snap->header->count;
+	}else{
+		if(!(in = openInput(inFile))) exit(100);
+		numLines = inputEstimate(in);
 	}
-	*hash = HASH_Create(getHashKey, compareId, getPrime(getNumLinesInFile(fp) * 2) );
+	// a snapshot stores the hash's slots, so its hash must have as many
+	hashSize = snap ? (int)snap->header->hashSize : getPrime(numLines * 2);
+	*hash = HASH_CreateEngine(getHashKey, compareId, hashSize, HASH_OPEN);
 	if(!*hash) printf("\nHash wouldn't create\n"), exit(100);
 	*nameTree = CreateTree(compareName, freePrisoner, NULL);
     if(!*nameTree) printf("\nNameTree wouldn't create \n"), exit(100);
 	*idTree = CreateTree(compareId, freePrisoner, NULL);
 	if(!*idTree) printf("\nIdTree wouldn't create\n"), exit(100);
-
-	while(myGets(fp, buff, 256) != EOF){
-		if(!(prisoner = createPrisoner(buff))) printf("error creating prisoner");    
-		if(!addPrisoner(*hash, *nameTree, *idTree, prisoner)){
-			printf("\nerror inserting:\n");
-	   		printPrisoner(prisoner);
-		}
+	// compareId orders by idNum, so both id indexes can compare it directly
+	SetIntKey(*idTree, offsetof(PRISONER, idNum));
+	SetKeyPrefix(*nameTree, namePrefix);
+	HASH_SetIntKey(*hash, offsetof(PRISONER, idNum));
+
+	if(snap){
+		// records are copied out, so the file is done with once they are in
+		if(!loadSnapshot(snap, *hash, *nameTree, *idTree)) printf("\nSnapshot wouldn't load\n"), exit(100);
+		closeSnapshot(snap);
+		return;
 	}
-	fclose(fp);
+
+	// parsed in parallel; the hash rejects duplicate id's just as addPrisoner does,
+	// and each tree is sorted and built by a thread of its own (ingest.c)
+	if(!ingestIndexes(in, hash, *nameTree, *idTree)) printf("\nTrees wouldn't build\n"), exit(100);
+	printf("%lld records read at %.0f records/sec\n", in->records, inputRate(in));
+	closeInput(in);
 }
 
-void readFile(HASH** hash, TREE* nameTree, TREE* idTree, char* inFile)
+void readFile(PRISON_DB* db, char* inFile)
 {
-	char buff[256];
-	PRISONER *prisoner; 
+	INPUT* in = openInput(inFile);
+
+	if(!in) exit(100);
+	// parsed in parallel, but each record takes the write lock on its own, so readers
+	// get in between records; name searches go on seeing the names as they were
+	// until the whole file is in; records come in file order, so of two with the
+	// same id the first in the file is the one kept
+	ingestFile(in, addBatchLocked, db, 1);
+	printf("%lld records read at %.0f records/sec\n", in->records, inputRate(in));
+	closeInput(in);
+	publishNames(db);
+}
 
-	FILE* fp = fopen(inFile, "r");
-	if(!fp){
-		printf("\nerror opening input\n");
-		exit(100);
-	}
-	
-	while(myGets(fp, buff, 256) != EOF){
-		if(!(prisoner = createPrisoner(buff))) printf("error creating prisoner");    
-		if(HASH_Load(*hash) >= 75){
-			HASH_ReHash(hash, getPrime);
-		}
-		if(!addPrisoner(*hash, nameTree, idTree, prisoner)){
+/******************************************************
+ *  ingestFile consumer for readFile: adds a batch of
+ *  records one at a time with addPrisonerLocked and
+ *  syncs the journal once for the batch
+ *  ************************************************/
+void addBatchLocked(PRISONER** records, long long* offsets, int count, void* db)
+{
+	int i;
+
+	// readFile asks for the parts in file order (ordered=1), so the offsets aren't needed
+	(void)offsets;
+	for(i = 0; i < count; i++){
+		if(!addPrisonerLocked(db, records[i])){
 			printf("\nerror inserting:\n");
-	   		printPrisoner(prisoner);
+	   		printPrisoner(records[i]);
+			freePrisoner(records[i]);
 		}
 	}
-	fclose(fp);
-}
-
-int getNumLinesInFile(FILE* fp)
-{
-	char temp[1000];
-	int lineCount = 0;
-	if(!fp) return 0;
-	while(fgets(temp, 1000, fp)) lineCount++;
-	rewind(fp);
-	return lineCount;
+	journalSync(((PRISON_DB*)db)->journal);
 }
 
 /*********************  getting user input ******************************************/
@@ -93,7 +108,7 @@ int getNumLinesInFile(FILE* fp)
 PRISONER* getNewPrisoner(void)
 {
 	PRISONER* prisoner = xMalloc(sizeof(PRISONER));
-	strcpy(prisoner->id, getPrisonerID());
+	setPrisonerID(prisoner, getPrisonerID());
 	prisoner->lName = makeString(getName("last", 0));
 	prisoner->fName = makeString(getName("first", 0));
 	prisoner->crime = getCrime();
@@ -130,6 +145,16 @@ char* getPrisonerID()
 	return id;
 }
 
+/**********************************************************
+ * copies id into the prisoner and parses it once into idNum,
+ * the key compareId actually compares
+ * *****************************************************/
+void setPrisonerID(PRISONER* prisoner, const char* id)
+{
+	strcpy(prisoner->id, id);
+	prisoner->idNum = (int) strtol(id, NULL, 10);
+}
+
 /**********************************************************
  * prompts user "enter [desc] name" validates, and returns
  * pointer to static char string, which may then be copied to final
@@ -312,39 +337,45 @@ int getMenuChoice(int n, ...)
 
 	
 
-void addManager(HASH** hash, TREE* nameTree, TREE* idTree)
+void addManager(PRISON_DB* db)
 {
 	PRISONER* prisoner;
 		
 	switch(getMenuChoice(2, "Add batch from file", "Add individual")){
-			case 1: readFile(hash, nameTree, idTree, getName("input file", 1));
+			case 1: readFile(db, getName("input file", 1));
 					break;	
 			case 2: prisoner = getNewPrisoner();
-					if(HASH_Load(*hash) >= 75){
-						HASH_ReHash(hash, getPrime);
-					}
-					if(!addPrisoner(*hash, nameTree, idTree, prisoner)){
+					if(!addPrisonerLocked(db, prisoner)){
 						printf("\nerror inserting:\n");
 						printPrisoner(prisoner);
 						putchar('\n');
 					}
+					journalSync(db->journal);
+					publishNames(db);
 					break;
 	}
 }
 
-void deleteManager(HASH* hash, TREE* nameTree, TREE* idTree)
+/******************************************************
+ * No lock is held while the user is answering: the candidates' id's are
+ * copied out of the name snapshot, each is looked up again (and shown) just
+ * before its question, and the delete itself goes by id under the write lock.
+ *  ************************************************/
+void deleteManager(PRISON_DB* db)
 {
-	PRISONER temp;
-	PRISONER* toDel = HASH_Retrieve(hash, &temp);
+	PRISONER temp, **matches;
+	FROZEN_TREE* names;
+	char (*ids)[6];
+	int count = 0, i, slot, chosen = 0;
 	memset(&temp, 0, sizeof(PRISONER)); //to clear any junk since whole record won't be populated
 	
 	switch(getMenuChoice(3, "Delete by ID", "Delete by Name", "Return to Menu")){
-		case 1: strcpy(temp.id, getPrisonerID());
-				if(!(toDel = HASH_Retrieve(hash, &temp))){
+		case 1: setPrisonerID(&temp, getPrisonerID());
+				if(!findById(db, &temp, printFound)){
 					printf("\nPrisoner %s not found.  Cannot delete. \n", temp.id);
 					return;
 				}
-				if(!deleteConfirm(toDel)) return;
+				chosen = yesNo("Do you want to delete this prisoner? ");
 				break;
 
 		case 2: 
@@ -352,51 +383,55 @@ void deleteManager(HASH* hash, TREE* nameTree, TREE* idTree)
 				temp.lName = makeString(getName("last", 0));
 				temp.fName = makeString(getName("first", 0));
 				printf("last: %s first: %s \n", temp.lName, temp.fName);
-				if(Search(nameTree, &temp)){
-					while((toDel = GetNextResult(nameTree)) && !deleteConfirm(toDel)) ;
-					FlushSearch(nameTree);
-					free(temp.lName);
-					free(temp.fName);
-					if(!toDel) return;
-				}
-				else{
-					printf("\nPrisoner %s, %s not found. Cannot delete.\n", temp.lName, temp.fName);
-					free(temp.lName);
-					free(temp.fName);
-					return;
+				names = ReaderEnter(db->names, &slot);
+				count = forEachName(names, &temp, NULL);
+				matches = xMalloc((count + 1) * sizeof(PRISONER*));
+				ids = xMalloc((count + 1) * sizeof(*ids));
+				FrozenSearchInto(names, &temp, (void**) matches, count);
+				for(i = 0; i < count; i++) strcpy(ids[i], matches[i]->id);
+				ReaderExit(db->names, slot);
+				free(matches);
+				if(!count) printf("\nPrisoner %s, %s not found. Cannot delete.\n", temp.lName, temp.fName);
+				free(temp.lName);
+				free(temp.fName);
+				for(i = 0; i < count && !chosen; i++){
+					setPrisonerID(&temp, ids[i]);
+					if(findById(db, &temp, printFound))
+						chosen = yesNo("Do you want to delete this prisoner? ");
 				}
+				free(ids);
 				break;
 		case 3: return;
 	}
 	
-	if(! HASH_Delete(hash, toDel)) printf("Couldn't delete from hash");
-	if(! DeleteAt(idTree, toDel, PRESERVE)) printf("Couldn't delte from ID tree\n");//T1 delete, t2 ->n-1 deleteAt pres, tn delete at destroy.
-	if(! DeleteAt(nameTree, toDel, DESTROY)) printf("Couldn't delete from nameTree\n");
+	if(chosen && !deletePrisonerLocked(db, &temp))
+		printf("\nPrisoner %s was already deleted.\n", temp.id);
+	if(chosen) publishNames(db);
 	return;
 }
 
 
-void searchManager(HASH* hash, TREE* nameTree)
+void searchManager(PRISON_DB* db)
 {	
-	PRISONER temp, *result;
-	int count;
+	PRISONER temp;
+	FROZEN_TREE* names;
+	int count = 0, slot;
 	memset(&temp, 0 , sizeof(PRISONER));
 	
 	switch(getMenuChoice(3, "Search by ID", "Search by Name", "Return to Menu")){
-		case 1:	strcpy(temp.id, getPrisonerID()); //by ID hash 
- 				result = HASH_Retrieve(hash, &temp);
-				if(result) printPrisoner(result);
-				else printf("\nRecord not found for %s \n", temp.id);
+		case 1:	setPrisonerID(&temp, getPrisonerID()); //by ID hash 
+				if(!findById(db, &temp, printPrisoner))
+					printf("\nRecord not found for %s \n", temp.id);
 				break;
 		case 2: temp.lName = makeString(getName("last", 0));		//by name tree
 				temp.fName = makeString(getName("first", 0));
-				if((count = Search(nameTree, &temp)))  {
+				names = ReaderEnter(db->names, &slot);
+				if((count = forEachName(names, &temp, NULL)))  {
 					printf("\n\n%d matching prisoners: \n\n", count);
-					while((result = (PRISONER*) GetNextResult(nameTree)))  {
-						printPrisoner(result);
-					}
+					forEachName(names, &temp, printPrisoner);
 				}
-				else printf("\nRecord not found for %s, %s \n", temp.lName, temp.fName);
+				ReaderExit(db->names, slot);
+				if(!count) printf("\nRecord not found for %s, %s \n", temp.lName, temp.fName);
 				free(temp.lName);
 				free(temp.fName);
 				break;
@@ -406,6 +441,128 @@ void searchManager(HASH* hash, TREE* nameTree)
 
 }
 
+/******************************************************
+ *  Initializes the lock shared by the three indexes and publishes the
+ *  first snapshot of the name tree. Where the library allows it, a
+ *  waiting writer goes ahead of new readers, so a steady stream of id
+ *  queries can't hold off the intake thread indefinitely. None of the
+ *  callers take the read lock twice, which that would deadlock.
+ *  ************************************************/
+void initShared(PRISON_DB* db)
+{
+	pthread_rwlockattr_t attr;
+
+	pthread_rwlockattr_init(&attr);
+#ifdef __GLIBC__
+	pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+	if(pthread_rwlock_init(&db->lock, &attr)) printf("\nLock wouldn't initialize\n"), exit(100);
+	pthread_rwlockattr_destroy(&attr);
+	if(!(db->names = PublishTree(db->nameTree))) printf("\nNames wouldn't publish\n"), exit(100);
+}
+
+/******************************************************
+ *  Reader entry points, safe to call from any number of threads at once.
+ *  The record is looked up and passed to process (if not NULL) while the
+ *  read lock (findById) or the name snapshot (findByName) is held, so
+ *  process must not keep the pointer afterwards. findByName takes no lock
+ *  and never waits for a writer; it sees the names as of the last publish.
+ *  findById returns 1 if found, findByName the number of matches.
+ *  ************************************************/
+int findById(PRISON_DB* db, PRISONER* key, void (*process)(void* record))
+{
+	PRISONER* result;
+
+	pthread_rwlock_rdlock(&db->lock);
+	result = HASH_Retrieve(db->hash, key);
+	if(result && process) process(result);
+	pthread_rwlock_unlock(&db->lock);
+	return result != NULL;
+}
+
+int findByName(PRISON_DB* db, PRISONER* key, void (*process)(void* record))
+{
+	int count, slot;
+
+	count = forEachName(ReaderEnter(db->names, &slot), key, process);
+	ReaderExit(db->names, slot);
+	return count;
+}
+
+/******************************************************
+ *  Passes every record in the names snapshot matching key's name to
+ *  process (if not NULL), in name order.
+ *  returns the number of matches
+ *  ************************************************/
+int forEachName(FROZEN_TREE* names, PRISONER* key, void (*process)(void* record))
+{
+	int pos, count = 0;
+
+	for(pos = FrozenLowerBound(names, key); pos && !compareName(FrozenAt(names, pos), key); pos = FrozenNext(names, pos)){
+		if(process) process(FrozenAt(names, pos));
+		count++;
+	}
+	return count;
+}
+
+/******************************************************
+ *  Writer entry point: removes the prisoner whose id matches key's
+ *  from all three indexes under the write lock. Name searches stop
+ *  finding it after the next publishNames, so a batch of deletes
+ *  republishes once; the record is freed once no name search can
+ *  still reach it.
+ *  The delete is journaled and on disk before this returns.
+ *  returns 1 if deleted, 0 if no such prisoner
+ *  ************************************************/
+int deletePrisonerLocked(PRISON_DB* db, PRISONER* key)
+{
+	PRISONER* toDel;
+
+	pthread_rwlock_wrlock(&db->lock);
+	if((toDel = HASH_Retrieve(db->hash, key))){
+		if(! HASH_Delete(db->hash, toDel)) printf("Couldn't delete from hash");
+		if(! DeleteAt(db->idTree, toDel, PRESERVE)) printf("Couldn't delte from ID tree\n");//T1 delete, t2 ->n-1 deleteAt pres, tn delete at destroy.
+		if(! DeleteAt(db->nameTree, toDel, PRESERVE)) printf("Couldn't delete from nameTree\n");
+		journalDelete(db->journal, toDel);
+		if(! RetireData(db->names, toDel, freePrisoner)) printf("Couldn't retire record, not freed\n");
+	}
+	pthread_rwlock_unlock(&db->lock);
+	if(toDel) journalSync(db->journal);
+	return toDel != NULL;
+}
+
+/******************************************************
+ *  Writer entry point: makes prisoners added since the last publish
+ *  visible to name searches. O(n), so batches publish once at the end.
+ *  ************************************************/
+void publishNames(PRISON_DB* db)
+{
+	pthread_rwlock_wrlock(&db->lock);
+	if(! Republish(db->names)) printf("Couldn't publish names\n");
+	pthread_rwlock_unlock(&db->lock);
+}
+
+/******************************************************
+ *  Writer entry point: grows the hash table if needed and adds the
+ *  prisoner to all three indexes under the write lock. Name searches
+ *  find it after the next publishNames. The add is journaled but only
+ *  on disk after the next journalSync, so a batch syncs once.
+ *  returns as addPrisoner
+ *  ************************************************/
+int addPrisonerLocked(PRISON_DB* db, PRISONER* prisoner)
+{
+	int success;
+
+	pthread_rwlock_wrlock(&db->lock);
+	if(HASH_Load(db->hash) >= 75){
+		HASH_ReHashIncremental(&db->hash, getPrime);
+	}
+	success = addPrisoner(db->hash, db->nameTree, db->idTree, prisoner);
+	if(success) journalAdd(db->journal, prisoner);
+	pthread_rwlock_unlock(&db->lock);
+	return success;
+}
+
 int addPrisoner(HASH* hash, TREE* nameTree, TREE* idTree, PRISONER* prisoner)
 {
 	int hashStatus;
@@ -442,6 +599,7 @@ PRISONER* createPrisoner(char* string)
 	if(!newRecord) return NULL;
 	sscanf(string, "%[^;];%[^,],%[^;];%d;%lld;%lld;%c;%s", newRecord->id, tempL, tempF, (int*) &newRecord->crime, 
 			(long long*) &newRecord->admitDate, (long long*) &newRecord->projReleaseDate, &newRecord->cellBlock, newRecord->cell);	
+	newRecord->idNum = (int) strtol(newRecord->id, NULL, 10);
 	newRecord->fName = makeString(tempF);
 	newRecord->lName = makeString(tempL);	
 	
@@ -523,15 +681,18 @@ char* makeString(const char str[])
  *                       >0 means str 2 comes first in alphabetical order
  *OTHER
  *EfFECTS:
- *NOTES:
+ *NOTES:  characters compare as unsigned char, the
+ *        same way namePrefix packs them
  *************************************************/
 int strlcmp(const char *str1, const char * str2)
 {
-	while( tolower(*str1) == tolower(*str2)   && *str1!='\0' ){
-		++str1;
-		++str2;
+	const unsigned char *s1 = (const unsigned char*) str1, *s2 = (const unsigned char*) str2;
+
+	while( tolower(*s1) == tolower(*s2)   && *s1!='\0' ){
+		++s1;
+		++s2;
 	} // end while
-	return tolower(*str1)- tolower(*str2);
+	return tolower(*s1)- tolower(*s2);
 } // end strlcmp
 
 /**********************************************
@@ -602,16 +763,19 @@ void *xMalloc(size_t size)
 
 void freePrisoner(void *record)
 {
-	free(((PRISONER*)record)->fName);
-	free(((PRISONER*)record)->lName);
+	// nextPrisoner stores the names in the same allocation, right behind the record
+	if(((PRISONER*)record)->lName != (char*)((PRISONER*)record + 1)){
+		free(((PRISONER*)record)->fName);
+		free(((PRISONER*)record)->lName);
+	}
 	free(record);
 }
 
 int compareId(void* arg1, void* arg2)
 {
 	int firstArg, secondArg;
-	firstArg = (int) strtol(((PRISONER*)arg1)->id, NULL, 10); //TODO error checking on strtol
-	secondArg = (int) strtol(((PRISONER*)arg2)->id, NULL, 10);
+	firstArg = ((PRISONER*)arg1)->idNum; // parsed once by setPrisonerID/createPrisoner
+	secondArg = ((PRISONER*)arg2)->idNum;
 	if(firstArg == secondArg) return 0;
 	if(firstArg < secondArg) return -1;
 	return 1;
@@ -627,11 +791,45 @@ int compareName(void* arg1, void* arg2)
 	return compare;
 }
 
+/*******************************************
+ * key prefix for the name tree: the first 8
+ * characters of the last name, lower-cased as
+ * strlcmp sees them and packed first character
+ * highest, so a smaller prefix always means
+ * compareName would order the record first
+ * ****************************************/
+unsigned long long namePrefix(void* record)
+{
+	const char* name = ((PRISONER*)record)->lName;
+	unsigned long long prefix = 0;
+	int i;
+
+	for(i = 0; i < 8; i++){
+		prefix <<= 8;
+		if(*name) prefix |= (unsigned char)tolower((unsigned char)*name++);
+	}
+	return prefix;
+}
+
+/*******************************************
+ * qsort wrappers for compareId/compareName,
+ * used to sort an array of PRISONER pointers
+ * before building a tree from it
+ * ****************************************/
+int sortCompareId(const void* arg1, const void* arg2)
+{
+	return compareId(*(PRISONER**)arg1, *(PRISONER**)arg2);
+}
+
+int sortCompareName(const void* arg1, const void* arg2)
+{
+	return compareName(*(PRISONER**)arg1, *(PRISONER**)arg2);
+}
+
 
 
-int deleteConfirm(void* data)
+void printFound(void* record)
 {
 	printf("Prisoner found:\n");
-	printPrisoner(data);
-	return yesNo("Do you want to delete this prisoner? ");
+	printPrisoner(record);
 }
@@ -0,0 +1,448 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <libgen.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "team.h"
+
+/************************************************************************************
+ * Write-ahead journal of the prison database.
+ *
+ * Every add and delete made through the writer entry points is appended to
+ * <input>.journal while the write lock is held, so the journal has them in
+ * the order they were made:
+ *
+ *   JOURNAL_HEADER                   magic, version, byte order
+ *   JOURNAL_ENTRY + SNAP_RECORD      one per add or delete; an add is
+ *                 [+ names]          followed by "lName\0fName\0", padded
+ *                                    to 8 bytes
+ *
+ * Each entry carries hashBytes of what follows its header, seeded with the
+ * entry type, so a tail torn by a crash is recognised and cut off.
+ *
+ * Appending is a copy into a buffer. journalSync makes everything appended
+ * so far durable: one caller writes the buffer and syncs, and the callers
+ * that come in meanwhile wait for it and are covered by the next sync
+ * between them, so one fdatasync commits a whole group. An entry that finds
+ * the buffer full and can't get it written is dropped; until the next
+ * compaction saves the database whole, journalSync reports failure and
+ * journalDue asks for that compaction.
+ *
+ * Compaction saves the database as a snapshot, <input>.snap, and starts an
+ * empty journal. From then on startup loads that snapshot in place of the
+ * input and replays the journal on top of it. Replaying is safe even over
+ * a snapshot that already holds the journal (a crash between the two
+ * steps): each id's adds and deletes alternate, so the last one still wins.
+ **************************************************************************************/
+
+#define JOURNAL_MAGIC	"PRIJRNL"
+#define JOURNAL_VERSION	1
+#define JOURNAL_ADD		1
+#define JOURNAL_DELETE	2
+#define JOURNAL_BUFFER	(1 << 20)		// appended bytes held before they are written
+#define JOURNAL_COMPACT	10000			// entries worth a compaction
+#define JOURNAL_ALIGN(n)	(((n) + 7) & ~(size_t)7)
+
+static char* journalName(const char* inFile, const char* suffix);
+static int journalStart(const char* fileName);
+static void journalAppend(JOURNAL* journal, uint32_t type, const PRISONER* prisoner);
+static int journalWrite(JOURNAL* journal);
+static size_t journalReplayEntries(const char* map, size_t size, long long* applied,
+		HASH** hash, TREE* nameTree, TREE* idTree);
+static void syncDirectory(const char* fileName);
+
+/* ============== createJournal ================
+ * Pre: inFile is the input file named on the command line
+ * Post: return the journal's names worked out; base is the file setup is to
+ *       load: the compacted snapshot if there is one, else inFile
+ */
+JOURNAL* createJournal(const char* inFile)
+{
+	JOURNAL* journal = xMalloc(sizeof(JOURNAL));
+
+	memset(journal, 0, sizeof(JOURNAL));
+	journal->fd = -1;
+	journal->name = journalName(inFile, ".journal");
+	journal->snapName = journalName(inFile, ".snap");
+	journal->base = isSnapshot(journal->snapName) ? journal->snapName : (char*)inFile;
+	journal->buffer = xMalloc(JOURNAL_BUFFER);
+	pthread_mutex_init(&journal->lock, NULL);
+	pthread_cond_init(&journal->synced, NULL);
+	if (journal->base == journal->snapName)
+		printf("Loading %s, the last compaction of %s\n", journal->snapName, inFile);
+	return journal;
+}
+
+/* ============== replayJournal ================
+ * Pre: the indexes hold journal->base, loaded by setup, and no one else
+ *       uses them yet
+ * Post: every whole entry of the journal applied, a torn tail cut off and
+ *       the journal open for appending; return the entries applied, or -1
+ *       (journal closed, nothing appended from then on) if it can't be opened
+ */
+long long replayJournal(JOURNAL* journal, HASH** hash, TREE* nameTree, TREE* idTree)
+{
+	const JOURNAL_HEADER* header;
+	struct stat st;
+	size_t used = sizeof(JOURNAL_HEADER);
+	char* map;
+	int fd;
+
+	if ((fd = open(journal->name, O_RDWR)) < 0) {
+		if (!journalStart(journal->name) || (fd = open(journal->name, O_RDWR)) < 0) {
+			printf("\nCan't start journal %s, changes won't be kept\n", journal->name);
+			return -1;
+		}
+	}
+	if (fstat(fd, &st) || (size_t)st.st_size < sizeof(JOURNAL_HEADER)
+			|| (map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+		printf("\nCan't read journal %s, changes won't be kept\n", journal->name);
+		close(fd);
+		return -1;
+	}
+	header = (const JOURNAL_HEADER*)map;
+	if (memcmp(header->magic, JOURNAL_MAGIC, sizeof(header->magic)) || header->version != JOURNAL_VERSION
+			|| header->byteOrder != SNAP_BYTE_ORDER) {
+		printf("\nJournal %s is from another version, changes won't be kept\n", journal->name);
+		munmap(map, st.st_size);
+		close(fd);
+		return -1;
+	}
+	used = journalReplayEntries(map, st.st_size, &journal->entries, hash, nameTree, idTree);
+	munmap(map, st.st_size);
+	if (used < (size_t)st.st_size) {
+		printf("Journal %s ends in a torn entry, cut off\n", journal->name);
+		if (ftruncate(fd, used) || fdatasync(fd))
+			printf("\nCan't cut off the torn entry\n");
+	}
+	lseek(fd, used, SEEK_SET);
+	journal->fd = fd;
+	if (journal->entries)
+		printf("Replayed %lld changes from %s\n", journal->entries, journal->name);
+	return journal->entries;
+}
+
+/* ============== journalAdd ================
+ * Pre: caller holds the write lock and has just added prisoner
+ * Post: the add appended (not yet durable, see journalSync)
+ */
+void journalAdd(JOURNAL* journal, const PRISONER* prisoner)
+{
+	if (journal && journal->fd >= 0)
+		journalAppend(journal, JOURNAL_ADD, prisoner);
+}
+
+/* ============== journalDelete ================
+ * Pre: caller holds the write lock and has just deleted prisoner
+ * Post: the delete appended (not yet durable, see journalSync)
+ */
+void journalDelete(JOURNAL* journal, const PRISONER* prisoner)
+{
+	if (journal && journal->fd >= 0)
+		journalAppend(journal, JOURNAL_DELETE, prisoner);
+}
+
+/* ============== journalSync ================
+ * Pre: journal from createJournal, or NULL; no index lock held
+ * Post: every entry appended before the call is on disk; return 0 if
+ *       writing or syncing failed, or an entry was dropped since the last
+ *       compaction
+ */
+int journalSync(JOURNAL* journal)
+{
+	unsigned long long target, upto;
+	int success = 1;
+
+	if (!journal || journal->fd < 0)
+		return 1;
+	pthread_mutex_lock(&journal->lock);
+	target = journal->appended;
+	while (journal->durable < target) {
+		if (journal->syncing) {
+			pthread_cond_wait(&journal->synced, &journal->lock);
+			continue;
+		}
+		// this caller syncs for everyone appended so far
+		journal->syncing = 1;
+		success = journalWrite(journal);
+		upto = journal->appended;
+		pthread_mutex_unlock(&journal->lock);
+		success = !fdatasync(journal->fd) && success;
+		pthread_mutex_lock(&journal->lock);
+		if (success)
+			journal->durable = upto;
+		journal->syncing = 0;
+		pthread_cond_broadcast(&journal->synced);
+		if (!success)
+			break;
+	}
+	if (journal->dropped)
+		success = 0;
+	pthread_mutex_unlock(&journal->lock);
+	if (!success)
+		printf("\nCouldn't write journal %s\n", journal->name);
+	return success;
+}
+
+/* ============== journalDue ================
+ * Pre: journal from createJournal, or NULL
+ * Post: return 1 once enough entries have built up to compact, or one was
+ *       dropped and only a compaction saves it
+ */
+int journalDue(JOURNAL* journal)
+{
+	return journal && journal->fd >= 0 && (journal->entries >= JOURNAL_COMPACT || journal->dropped);
+}
+
+/* ============== compactJournal ================
+ * Saves the database as <input>.snap and starts an empty journal. Holds
+ * the read lock throughout, so no write comes in between the two.
+ * Pre: db shared (initShared); caller holds no lock
+ * Post: return 1 on success; on failure the journal is kept as it was
+ */
+int compactJournal(PRISON_DB* db)
+{
+	JOURNAL* journal = db->journal;
+	int success = 0, fd;
+
+	if (!journal || journal->fd < 0)
+		return 0;
+	pthread_rwlock_rdlock(&db->lock);
+	journalSync(journal);
+	pthread_mutex_lock(&journal->lock);
+	while (journal->syncing)
+		pthread_cond_wait(&journal->synced, &journal->lock);
+	if (saveSnapshot(db->idTree, db->nameTree, journal->snapName)) {
+		syncDirectory(journal->snapName);
+		if (journalStart(journal->name) && (fd = open(journal->name, O_RDWR | O_APPEND)) >= 0) {
+			// anything a failed sync left behind is in the snapshot
+			close(journal->fd);
+			journal->fd = fd;
+			journal->used = 0;
+			journal->durable = journal->appended;
+			journal->dropped = 0;
+			journal->entries = 0;
+			success = 1;
+		}
+	}
+	pthread_mutex_unlock(&journal->lock);
+	pthread_rwlock_unlock(&db->lock);
+	if (!success)
+		printf("\nCouldn't compact journal %s\n", journal->name);
+	return success;
+}
+
+/* ============== closeJournal ================
+ * Pre: journal from createJournal, or NULL
+ * Post: anything appended synced, file closed and journal freed; return NULL
+ */
+JOURNAL* closeJournal(JOURNAL* journal)
+{
+	if (journal) {
+		journalSync(journal);
+		if (journal->fd >= 0)
+			close(journal->fd);
+		pthread_mutex_destroy(&journal->lock);
+		pthread_cond_destroy(&journal->synced);
+		free(journal->buffer);
+		free(journal->name);
+		free(journal->snapName);
+		free(journal);
+	}
+	return NULL;
+}
+
+/* ============== journalName ================
+ * Pre: inFile and suffix are strings
+ * Post: return a new string, inFile followed by suffix
+ */
+static char* journalName(const char* inFile, const char* suffix)
+{
+	char* name = xMalloc(strlen(inFile) + strlen(suffix) + 1);
+
+	sprintf(name, "%s%s", inFile, suffix);
+	return name;
+}
+
+/* ============== journalStart ================
+ * Written under a temporary name and renamed into place like a snapshot.
+ * Pre: fileName is the journal's name
+ * Post: return 1 if fileName now durably holds an empty journal, else 0
+ *       (any earlier journal untouched)
+ */
+static int journalStart(const char* fileName)
+{
+	JOURNAL_HEADER header;
+	char* tempName = journalName(fileName, ".tmp");
+	int fd, success = 0;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, JOURNAL_MAGIC, sizeof(header.magic));
+	header.version = JOURNAL_VERSION;
+	header.byteOrder = SNAP_BYTE_ORDER;
+	if ((fd = open(tempName, O_WRONLY | O_CREAT | O_TRUNC, 0644)) >= 0) {
+		success = write(fd, &header, sizeof(header)) == sizeof(header) && !fdatasync(fd);
+		success = !close(fd) && success;
+		if (success)
+			success = !rename(tempName, fileName);
+		if (success)
+			syncDirectory(fileName);
+		else
+			remove(tempName);
+	}
+	free(tempName);
+	return success;
+}
+
+/* ============== journalAppend ================
+ * Pre: caller holds the write lock; journal open
+ * Post: the entry for prisoner copied to the buffer, which is written out
+ *       first if it hasn't room; if it still hasn't, the entry is dropped
+ *       and counted in journal->dropped
+ */
+static void journalAppend(JOURNAL* journal, uint32_t type, const PRISONER* prisoner)
+{
+	size_t lLen = type == JOURNAL_ADD ? strlen(prisoner->lName) + 1 : 0;
+	size_t fLen = type == JOURNAL_ADD ? strlen(prisoner->fName) + 1 : 0;
+	size_t size = JOURNAL_ALIGN(sizeof(JOURNAL_ENTRY) + sizeof(SNAP_RECORD) + lLen + fLen);
+	JOURNAL_ENTRY* entry;
+	SNAP_RECORD* rec;
+	char* names;
+
+	pthread_mutex_lock(&journal->lock);
+	// a sync going on meanwhile has written its part already and only waits on the disk
+	if (journal->used + size > JOURNAL_BUFFER)
+		journalWrite(journal);
+	if (journal->used + size > JOURNAL_BUFFER) {
+		if (size > JOURNAL_BUFFER)
+			printf("\nRecord %s too long to journal\n", prisoner->id);
+		else
+			printf("\nCouldn't write journal %s, record %s not journaled\n", journal->name, prisoner->id);
+		journal->dropped++;
+		pthread_mutex_unlock(&journal->lock);
+		return;
+	}
+	entry = (JOURNAL_ENTRY*)(journal->buffer + journal->used);
+	memset(entry, 0, size);
+	entry->type = type;
+	entry->size = (uint32_t)size;
+	rec = (SNAP_RECORD*)(entry + 1);
+	memcpy(rec->id, prisoner->id, sizeof(rec->id));
+	rec->idNum = prisoner->idNum;
+	if (type == JOURNAL_ADD) {
+		memcpy(rec->cell, prisoner->cell, sizeof(rec->cell));
+		rec->cellBlock = prisoner->cellBlock;
+		rec->crime = (int32_t)prisoner->crime;
+		rec->admitDate = (int64_t)prisoner->admitDate;
+		rec->projReleaseDate = (int64_t)prisoner->projReleaseDate;
+		names = (char*)(rec + 1);
+		rec->lName = 0;
+		rec->fName = (uint32_t)lLen;
+		memcpy(names, prisoner->lName, lLen);
+		memcpy(names + lLen, prisoner->fName, fLen);
+	}
+	entry->checksum = hashBytes(rec, size - sizeof(JOURNAL_ENTRY), type);
+	journal->used += size;
+	journal->appended++;
+	journal->entries++;
+	pthread_mutex_unlock(&journal->lock);
+}
+
+/* ============== journalWrite ================
+ * Pre: journal->lock held; no sync in progress or the caller is the one
+ * Post: buffer written to the file and emptied; return 0 if write failed,
+ *       with what was written taken off the buffer so a retry goes on from
+ *       there
+ */
+static int journalWrite(JOURNAL* journal)
+{
+	size_t done = 0;
+	ssize_t n;
+
+	while (done < journal->used) {
+		if ((n = write(journal->fd, journal->buffer + done, journal->used - done)) <= 0) {
+			memmove(journal->buffer, journal->buffer + done, journal->used - done);
+			journal->used -= done;
+			return 0;
+		}
+		done += n;
+	}
+	journal->used = 0;
+	return 1;
+}
+
+/* ============== journalReplayEntries ================
+ * Pre: map holds size bytes of a journal whose header has been checked
+ * Post: every whole entry applied to the indexes in order and counted in
+ *       *applied; return the bytes of whole entries, header included
+ */
+static size_t journalReplayEntries(const char* map, size_t size, long long* applied,
+		HASH** hash, TREE* nameTree, TREE* idTree)
+{
+	size_t pos = sizeof(JOURNAL_HEADER), length;
+	const JOURNAL_ENTRY* entry;
+	const SNAP_RECORD* rec;
+	const char* names;
+	PRISONER *prisoner, key;
+
+	while (size - pos >= sizeof(JOURNAL_ENTRY) + sizeof(SNAP_RECORD)) {
+		entry = (const JOURNAL_ENTRY*)(map + pos);
+		rec = (const SNAP_RECORD*)(entry + 1);
+		if (entry->size > size - pos || entry->size < sizeof(JOURNAL_ENTRY) + sizeof(SNAP_RECORD)
+				|| entry->size % 8 || (entry->type != JOURNAL_ADD && entry->type != JOURNAL_DELETE)
+				|| entry->checksum != hashBytes(rec, entry->size - sizeof(JOURNAL_ENTRY), entry->type))
+			break;
+		if (entry->type == JOURNAL_ADD) {
+			names = (const char*)(rec + 1);
+			length = entry->size - sizeof(JOURNAL_ENTRY) - sizeof(SNAP_RECORD);
+			if (rec->fName >= length || !memchr(names, '\0', rec->fName)
+					|| !memchr(names + rec->fName, '\0', length - rec->fName))
+				break;
+			prisoner = xMalloc(sizeof(PRISONER));
+			memcpy(prisoner->id, rec->id, sizeof(prisoner->id));
+			prisoner->id[sizeof(prisoner->id) - 1] = '\0';
+			memcpy(prisoner->cell, rec->cell, sizeof(prisoner->cell));
+			prisoner->cell[sizeof(prisoner->cell) - 1] = '\0';
+			prisoner->cellBlock = rec->cellBlock;
+			prisoner->idNum = rec->idNum;
+			prisoner->crime = (crime_t)rec->crime;
+			prisoner->admitDate = (time_t)rec->admitDate;
+			prisoner->projReleaseDate = (time_t)rec->projReleaseDate;
+			prisoner->lName = makeString(names);
+			prisoner->fName = makeString(names + rec->fName);
+			if (HASH_Load(*hash) >= 75)
+				HASH_ReHash(hash, getPrime);
+			if (!addPrisoner(*hash, nameTree, idTree, prisoner))
+				freePrisoner(prisoner);
+		} else {
+			memset(&key, 0, sizeof(key));
+			key.idNum = rec->idNum;
+			memcpy(key.id, rec->id, sizeof(key.id));
+			key.id[sizeof(key.id) - 1] = '\0';
+			if ((prisoner = HASH_Delete(*hash, &key))) {
+				if (!DeleteAt(idTree, prisoner, PRESERVE)) printf("Couldn't delete from ID tree\n");
+				if (!DeleteAt(nameTree, prisoner, PRESERVE)) printf("Couldn't delete from nameTree\n");
+				freePrisoner(prisoner);
+			}
+		}
+		pos += entry->size;
+		(*applied)++;
+	}
+	return pos;
+}
+
+/* ============== syncDirectory ================
+ * Pre: fileName was just created or renamed
+ * Post: the directory holding it synced, so the name itself is durable
+ */
+static void syncDirectory(const char* fileName)
+{
+	char* copy = makeString(fileName);
+	int fd = open(dirname(copy), O_RDONLY);
+
+	if (fd >= 0) {
+		fsync(fd);
+		close(fd);
+	}
+	free(copy);
+}
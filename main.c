@@ -3,36 +3,61 @@
 
 int main(int argc, char* argv[])
 {
-	HASH* hash;
-	TREE *nameTree, *idTree;
+	PRISON_DB db;
+	char* fileName;
 	int choice;
 
 	printWelcome();
-	setup(&hash, &nameTree, &idTree, argv[1]);
-	while( (choice = getMenuChoice(9, "Add prisoner(s)", "Delete prisoner", "Search for prisoner",
+	if(argc < 2) printf("\nusage: %s inputfile\n", argv[0]), exit(100);
+	if(!(db.journal = createJournal(argv[1]))) printf("\nCouldn't set up the journal of %s\n", argv[1]), exit(100);
+	setup(&db.hash, &db.nameTree, &db.idTree, db.journal->base);
+	replayJournal(db.journal, &db.hash, db.nameTree, db.idTree);
+	initShared(&db);
+	while( (choice = getMenuChoice(10, "Add prisoner(s)", "Delete prisoner", "Search for prisoner",
 					"Print Hash Table", "Print prisoners in ID order", "Print Indented Name Tree",
-					"Save all records to file", "Print efficiency report", "Quit")) != 9 ){
+					"Save all records to file", "Print efficiency report", "Save snapshot", "Quit")) != 10 ){
 		switch(choice){
-		case 1: addManager(&hash, nameTree, idTree);
+		case 1: addManager(&db);
 				break;
-		case 2: deleteManager(hash, nameTree, idTree);
+		case 2: deleteManager(&db);
 				break;
-		case 3: searchManager(hash, nameTree);
+		case 3: searchManager(&db);
 				break;
-		case 4: HASH_Testing(hash, printIndex, printPrisonerBrief);
+		case 4: pthread_rwlock_rdlock(&db.lock);
+				HASH_Testing(db.hash, printIndex, printPrisonerBrief);
+				pthread_rwlock_unlock(&db.lock);
 				break;
-		case 5: Traverse(idTree, printPrisonerBrief);
+		case 5: pthread_rwlock_rdlock(&db.lock);
+				Traverse(db.idTree, printPrisonerBrief);
+				pthread_rwlock_unlock(&db.lock);
 				break;
-		case 6: PrintNested(nameTree, printPrisonerBrief, 0);
+		case 6: pthread_rwlock_rdlock(&db.lock);
+				PrintNested(db.nameTree, printPrisonerBrief, 0);
+				pthread_rwlock_unlock(&db.lock);
 			   	break;
-		case 7: HASH_SaveFile(hash, getName("ouput file", 1), writeFile);
+		case 7: fileName = getName("ouput file", 1);
+				pthread_rwlock_rdlock(&db.lock);
+				saveRecords(db.hash, fileName);
+				pthread_rwlock_unlock(&db.lock);
 				break;
-		case 8:	printEfficiency(hash);
+		case 8:	pthread_rwlock_rdlock(&db.lock);
+				printEfficiency(db.hash);
+				pthread_rwlock_unlock(&db.lock);
+				break;
+		case 9: fileName = getName("snapshot file", 1);
+				pthread_rwlock_rdlock(&db.lock);
+				if(!saveSnapshot(db.idTree, db.nameTree, fileName)) printf("\nCouldn't save snapshot\n");
+				pthread_rwlock_unlock(&db.lock);
 				break;
 		default: printf("WTF this isn't supposed to be able to happen\n");
 		}
+		if(journalDue(db.journal)) compactJournal(&db);
 	}
-	cleanUp(&hash, &nameTree, &idTree);
+	compactJournal(&db);
+	db.journal = closeJournal(db.journal);
+	pthread_rwlock_destroy(&db.lock);
+	db.names = DestroyPublished(db.names);
+	cleanUp(&db.hash, &db.nameTree, &db.idTree);
 
 	return 0;
 }
@@ -0,0 +1,361 @@
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "team.h"
+
+/************************************************************************************
+ * Single pass reader for the text input format
+ *
+ *   id;lName,fName;crime;admitDate;projReleaseDate;cellBlock;cell
+ *
+ * The file is mapped once and read front to back. The delimiters are found
+ * 16 bytes at a time (SSE2 where the compiler has it, a byte loop elsewhere)
+ * and the numbers are converted in place, so nothing is copied into a line
+ * buffer and nothing goes through sscanf. Each record is one allocation: the
+ * names are stored right behind the PRISONER, which freePrisoner knows.
+ *
+ * Nothing counts the lines first. inputEstimate guesses the record count
+ * from the bytes per record seen so far, which is enough to size the hash
+ * and the record array and to correct them as the file goes by.
+ *
+ * The mapping is only address space: pages already read are handed back
+ * every INPUT_RELEASE bytes, so a file of several GB is read with about that
+ * much of it resident.
+ *
+ * splitInput cuts an open file into parts at line boundaries; each part is
+ * read with nextPrisoner like a whole file, so one thread can read each.
+ **************************************************************************************/
+
+#define INPUT_RELEASE	(64 << 20)
+#define INPUT_SAMPLE	(64 << 10)
+#define INPUT_FIELDS	8
+
+static const char* nextDelim(INPUT* in, const char* p);
+static unsigned int delimMask(const char* p);
+static int parseNumber(const char* p, const char* end, long long* value);
+static PRISONER* buildPrisoner(const char** start, const char** stop);
+static void releaseRead(INPUT* in);
+static const char* lineAfter(const INPUT* in, const char* p);
+
+/* ============== openInput ================
+ * Pre: fileName is the name of a text input file
+ * Post: return the file mapped and ready for nextPrisoner, or NULL with a
+ *       message if it could not be opened
+ */
+INPUT* openInput(const char* fileName)
+{
+	INPUT* in;
+	struct stat st;
+	int fd;
+
+	if ((fd = open(fileName, O_RDONLY)) < 0 || fstat(fd, &st)) {
+		printf("\nerror opening input\n");
+		if (fd >= 0)
+			close(fd);
+		return NULL;
+	}
+	in = xMalloc(sizeof(INPUT));
+	memset(in, 0, sizeof(INPUT));
+	in->size = (size_t)st.st_size;
+	if (in->size) {
+		in->map = mmap(NULL, in->size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (in->map == MAP_FAILED) {
+			printf("\nerror mapping input\n");
+			close(fd);
+			free(in);
+			return NULL;
+		}
+		madvise((void*)in->map, in->size, MADV_SEQUENTIAL);
+	}
+	close(fd);
+	in->pos = in->first = in->released = in->map;
+	in->end = in->map + in->size;
+	clock_gettime(CLOCK_MONOTONIC, &in->started);
+	return in;
+}
+
+/* ============== closeInput ================
+ * Pre: in returned by openInput
+ * Post: file unmapped and in freed
+ */
+void closeInput(INPUT* in)
+{
+	if (!in->whole && in->size)
+		munmap((void*)in->map, in->size);
+	free(in);
+}
+
+/* ============== inputEstimate ================
+ * Before any record is read the first INPUT_SAMPLE bytes are counted;
+ * afterwards the records read so far are the sample.
+ * Pre: in open
+ * Post: return the expected number of records in the whole file, at least
+ *       the number already read
+ */
+int inputEstimate(INPUT* in)
+{
+	size_t done = (size_t)(in->pos - in->map), sample, lines = 0;
+	const char *p, *end;
+	double estimate;
+
+	if (in->records) {
+		estimate = in->records + (double)(in->size - done) * in->records / done;
+		return estimate > INT_MAX ? INT_MAX : (int)estimate + 1;
+	}
+	sample = in->size < INPUT_SAMPLE ? in->size : INPUT_SAMPLE;
+	for (p = in->map, end = in->map + sample; p < end && (p = memchr(p, '\n', end - p)); p++)
+		lines++;
+	if (!lines)
+		return 1;
+	estimate = (double)in->size * lines / sample;
+	return estimate > INT_MAX ? INT_MAX : (int)estimate + 1;
+}
+
+/* ============== nextPrisoner ================
+ * Blank lines are skipped; a line that is not a record is reported with its
+ * line number and skipped.
+ * Pre: in open
+ * Post: return the next record, newly allocated and to be freed with
+ *       freePrisoner, or NULL at the end of the file
+ */
+PRISONER* nextPrisoner(INPUT* in)
+{
+	const char *start[INPUT_FIELDS], *stop[INPUT_FIELDS];
+	const char *p, *d, *eol;
+	PRISONER* prisoner;
+	int field;
+
+	while (in->pos < in->end) {
+		p = in->pos;
+		in->line++;
+		for (field = 0; field < INPUT_FIELDS; field++) {
+			d = nextDelim(in, p);
+			start[field] = p;
+			stop[field] = d;
+			if (d == in->end || *d == '\n' || field == INPUT_FIELDS - 1)
+				break;
+			if (*d != (field == 1 ? ',' : ';'))
+				break;
+			p = d + 1;
+		}
+		eol = (d < in->end && *d != '\n') ? memchr(d, '\n', in->end - d) : d;
+		in->pos = eol ? eol + 1 : in->end;
+		if (in->pos > in->end)
+			in->pos = in->end;
+		if (in->pos - in->released >= INPUT_RELEASE)
+			releaseRead(in);
+
+		if (field == 0 && stop[0] - start[0] <= (stop[0] > start[0] && stop[0][-1] == '\r'))
+			continue;	// blank line
+		if (field == INPUT_FIELDS - 1 && (d == in->end || *d == '\n')
+				&& (prisoner = buildPrisoner(start, stop))) {
+			in->records++;
+			return prisoner;
+		}
+		if (in->whole)
+			printf("line %lld after byte %lld is not a prisoner record, skipped\n",
+					in->line, (long long)(in->first - in->map));
+		else
+			printf("line %lld is not a prisoner record, skipped\n", in->line);
+	}
+	return NULL;
+}
+
+/* ============== splitInput ================
+ * Each part starts on the line after its share of the bytes would start,
+ * so no line is split and a part may come out empty. Pages are released
+ * only from the first page wholly inside a part, never one a neighbour is
+ * still reading.
+ * Pre: in open and not yet read; parts has room for n
+ * Post: parts filled with n parts which between them cover the whole file;
+ *       each is closed with closeInput before in is
+ */
+void splitInput(INPUT* in, INPUT** parts, int n)
+{
+	long page = sysconf(_SC_PAGESIZE);
+	const char* start = in->map;
+	const char* stop;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		stop = i == n - 1 ? in->end : lineAfter(in, in->map + in->size / n * (i + 1));
+		if (stop < start)
+			stop = start;
+		parts[i] = xMalloc(sizeof(INPUT));
+		*parts[i] = *in;
+		parts[i]->whole = in;
+		parts[i]->pos = parts[i]->first = start;
+		parts[i]->end = stop;
+		parts[i]->released = in->map + ((size_t)(start - in->map) + page - 1) / page * page;
+		parts[i]->block = NULL;
+		start = stop;
+	}
+}
+
+/* ============== inputRate ================
+ * Pre: in open
+ * Post: return the records read per second since openInput
+ */
+double inputRate(INPUT* in)
+{
+	struct timespec now;
+	double seconds;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	seconds = (now.tv_sec - in->started.tv_sec) + (now.tv_nsec - in->started.tv_nsec) / 1e9;
+	return seconds > 0 ? in->records / seconds : 0;
+}
+
+/* ============== lineAfter ================
+ * Pre: p inside in's mapping
+ * Post: return the start of the first line beginning after p, or in->end
+ */
+static const char* lineAfter(const INPUT* in, const char* p)
+{
+	if (p >= in->end)
+		return in->end;
+	p = memchr(p, '\n', in->end - p);
+	return p ? p + 1 : in->end;
+}
+
+/* ============== nextDelim ================
+ * Masks are worked out a block of 16 bytes at a time and kept, so the
+ * fields of one record usually cost a single compare between them.
+ * Pre: in->map <= p <= in->end
+ * Post: return the first ';' ',' or '\n' at or after p, or in->end
+ */
+static const char* nextDelim(INPUT* in, const char* p)
+{
+	unsigned int mask;
+
+	for (;;) {
+		if (in->block && p >= in->block && p < in->block + 16) {
+			mask = in->mask & (~0u << (p - in->block));
+			if (mask)
+				return in->block + __builtin_ctz(mask);
+			p = in->block + 16;
+		}
+		if (in->end - p < 16)
+			break;
+		in->block = p;
+		in->mask = delimMask(p);
+	}
+	while (p < in->end && *p != ';' && *p != ',' && *p != '\n')
+		p++;
+	return p;
+}
+
+/* ============== delimMask ================
+ * Pre: 16 bytes readable at p
+ * Post: return a mask with bit i set when p[i] is ';' ',' or '\n'
+ */
+static unsigned int delimMask(const char* p)
+{
+#ifdef __SSE2__
+	__m128i block = _mm_loadu_si128((const __m128i*)p);
+	__m128i hits = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8(';')),
+			_mm_cmpeq_epi8(block, _mm_set1_epi8(','))), _mm_cmpeq_epi8(block, _mm_set1_epi8('\n')));
+
+	return (unsigned int)_mm_movemask_epi8(hits);
+#else
+	unsigned int mask = 0;
+	int i;
+
+	for (i = 0; i < 16; i++)
+		if (p[i] == ';' || p[i] == ',' || p[i] == '\n')
+			mask |= 1u << i;
+	return mask;
+#endif
+}
+
+/* ============== parseNumber ================
+ * Pre: [p, end) is one field
+ * Post: value set and return 1 if the field is an optionally signed decimal
+ *       number, with surrounding blanks allowed; return 0 otherwise
+ */
+static int parseNumber(const char* p, const char* end, long long* value)
+{
+	unsigned long long n = 0;
+	int negative = 0;
+	const char* digits;
+
+	while (p < end && isspace((unsigned char)*p))
+		p++;
+	if (p < end && (*p == '-' || *p == '+'))
+		negative = *p++ == '-';
+	for (digits = p; p < end && (unsigned)(*p - '0') < 10; p++)
+		n = n * 10 + (*p - '0');
+	while (p < end && isspace((unsigned char)*p))
+		p++;
+	if (p == digits || p != end || p - digits > 18)
+		return 0;
+	*value = negative ? -(long long)n : (long long)n;
+	return 1;
+}
+
+/* ============== buildPrisoner ================
+ * Pre: start/stop bound the INPUT_FIELDS fields of one line
+ * Post: return the record in one allocation, names behind the PRISONER, or
+ *       NULL if a field is empty, too long or not a number
+ */
+static PRISONER* buildPrisoner(const char** start, const char** stop)
+{
+	size_t idLen = stop[0] - start[0], lLen = stop[1] - start[1], fLen = stop[2] - start[2], cellLen;
+	long long crime, admit, release, idNum = 0;
+	const char *cell = start[7], *p;
+	PRISONER* prisoner;
+
+	// the cell runs to the first blank, which also drops a '\r' before the newline
+	while (cell < stop[7] && isspace((unsigned char)*cell))
+		cell++;
+	for (p = cell; p < stop[7] && !isspace((unsigned char)*p); p++)
+		;
+	cellLen = p - cell;
+	if (!idLen || idLen >= sizeof(prisoner->id) || !lLen || !fLen
+			|| stop[6] - start[6] != 1 || !cellLen || cellLen >= sizeof(prisoner->cell)
+			|| !parseNumber(start[3], stop[3], &crime) || !parseNumber(start[4], stop[4], &admit)
+			|| !parseNumber(start[5], stop[5], &release))
+		return NULL;
+	for (p = start[0]; p < stop[0] && (unsigned)(*p - '0') < 10; p++)
+		idNum = idNum * 10 + (*p - '0');
+
+	prisoner = xMalloc(sizeof(PRISONER) + lLen + 1 + fLen + 1);
+	memcpy(prisoner->id, start[0], idLen);
+	prisoner->id[idLen] = '\0';
+	prisoner->idNum = (int)idNum;
+	prisoner->lName = (char*)(prisoner + 1);
+	memcpy(prisoner->lName, start[1], lLen);
+	prisoner->lName[lLen] = '\0';
+	prisoner->fName = prisoner->lName + lLen + 1;
+	memcpy(prisoner->fName, start[2], fLen);
+	prisoner->fName[fLen] = '\0';
+	prisoner->crime = (crime_t)crime;
+	prisoner->admitDate = (time_t)admit;
+	prisoner->projReleaseDate = (time_t)release;
+	prisoner->cellBlock = *start[6];
+	memcpy(prisoner->cell, cell, cellLen);
+	prisoner->cell[cellLen] = '\0';
+	return prisoner;
+}
+
+/* ============== releaseRead ================
+ * Pre: in open
+ * Post: whole pages before in->pos dropped from memory; they are only read
+ *       again if something touches them, which nothing does
+ */
+static void releaseRead(INPUT* in)
+{
+	long page = sysconf(_SC_PAGESIZE);
+	size_t from = (size_t)(in->released - in->map);
+	size_t to = (size_t)(in->pos - in->map) / page * page;
+
+	if (to > from) {
+		madvise((void*)(in->map + from), to - from, MADV_DONTNEED);
+		in->released = in->map + to;
+	}
+}
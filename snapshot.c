@@ -0,0 +1,409 @@
+#include <stdint.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "team.h"
+
+/************************************************************************************
+ * Binary snapshots of the prison database.
+ *
+ * A snapshot holds every record plus the indexes over them, laid out so the
+ * file can be mapped and used where it lies: all links are offsets from the
+ * start of the file or indexes into the record array, never pointers.
+ *
+ *   SNAP_HEADER                      magic, version, byte order, sizes, checksum
+ *   SNAP_RECORD   records[count]     in ascending idNum order, so the id order
+ *                                    needs no index of its own
+ *   uint32_t      nameOrder[count]   record indexes in compareName order
+ *   uint32_t      hash[hashSize]     the slots of the id hash, laid out as the
+ *                                    open addressing engine (getHashKey) lays
+ *                                    out a table of hashSize slots; record
+ *                                    index + 1, 0 for an empty slot
+ *   char          strings[]          NUL-terminated names
+ *
+ * Every section starts on an 8 byte boundary. The checksum is hashBytes of
+ * everything after the header, seed 0. openSnapshot checks it and every
+ * offset and index before handing the mapping out.
+ *
+ * setup() loads a snapshot instead of a text file when it is given one. The
+ * records are copied out of the mapping into PRISONERs, which the indexes
+ * own, and the file is closed again; nothing is parsed, sorted or probed:
+ * both trees are built from the stored orders with BuildTreeSorted, and each
+ * record goes straight into its stored slot of the hash (HASH_SetSlots).
+ **************************************************************************************/
+
+#define SNAP_ALIGN(n)	(((n) + 7) & ~(uint64_t)7)
+
+static uint64_t snapChecksum(const void* body, uint64_t size);
+static uint32_t snapIndex(PRISONER** byId, uint32_t count, int idNum);
+static uint32_t snapHome(const SNAPSHOT* snap, uint32_t index);
+static int snapCheck(const SNAPSHOT* snap);
+
+
+/* ============== isSnapshot ================
+ * Pre: fileName names a file (it may not exist)
+ * Post: return 1 if it starts with the snapshot magic, else 0
+ */
+int isSnapshot(const char* fileName)
+{
+	char magic[sizeof(SNAP_MAGIC)];
+	FILE* fp = fopen(fileName, "rb");
+	int found;
+
+	if (!fp)
+		return 0;
+	found = fread(magic, 1, sizeof(magic), fp) == sizeof(magic)
+	        && !memcmp(magic, SNAP_MAGIC, sizeof(magic));
+	fclose(fp);
+	return found;
+}
+
+/* ============== saveSnapshot ================
+ * Writes the records of idTree (which must hold the same records as
+ * nameTree) to fileName as a snapshot. The file is written under a
+ * temporary name, synced and renamed into place, so a crash part way
+ * through leaves any earlier snapshot intact.
+ * Pre: trees built; caller keeps them from changing meanwhile
+ * Post: return 1 on success, 0 (file untouched) on failure
+ */
+int saveSnapshot(TREE* idTree, TREE* nameTree, const char* fileName)
+{
+	SNAP_HEADER header;
+	SNAP_RECORD* rec;
+	PRISONER** byId;
+	PRISONER* prisoner;
+	TREE_ITER iter;
+	HASH* layout;
+	void** slots;
+	uint32_t count = (uint32_t)TreeCount(idTree);
+	uint32_t *nameOrder, *hash;
+	uint32_t i, pos;
+	uint64_t stringsSize = 0, size;
+	char *body, *strings, *tempName;
+	FILE* fp;
+	int success;
+
+	byId = xMalloc((count + 1) * sizeof(PRISONER*));
+	for (i = 0, prisoner = IterBegin(idTree, &iter); prisoner; prisoner = IterNext(&iter)) {
+		byId[i++] = prisoner;
+		stringsSize += strlen(prisoner->lName) + strlen(prisoner->fName) + 2;
+	}
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, SNAP_MAGIC, sizeof(header.magic));
+	header.version = SNAP_VERSION;
+	header.byteOrder = SNAP_BYTE_ORDER;
+	header.count = count;
+	header.hashSize = (uint32_t)nextPrime(2 * (unsigned long long)count);
+	header.recordsOff = SNAP_ALIGN(sizeof(SNAP_HEADER));
+	header.nameOrderOff = SNAP_ALIGN(header.recordsOff + (uint64_t)count * sizeof(SNAP_RECORD));
+	header.hashOff = SNAP_ALIGN(header.nameOrderOff + (uint64_t)count * sizeof(uint32_t));
+	header.stringsOff = SNAP_ALIGN(header.hashOff + (uint64_t)header.hashSize * sizeof(uint32_t));
+	header.stringsSize = stringsSize;
+	header.fileSize = header.stringsOff + stringsSize;
+
+	// the body is built in memory (zeroed, so padding is deterministic) and
+	// written with one fwrite once its checksum is known
+	size = header.fileSize - sizeof(SNAP_HEADER);
+	body = calloc(1, size);
+	// the id index is laid out by a hash like the one setup creates, so
+	// loading puts every record straight into its slot
+	layout = HASH_CreateEngine(getHashKey, compareId, (int)header.hashSize, HASH_OPEN);
+	slots = malloc(header.hashSize * sizeof(void*));
+	success = body && layout && slots;
+	if (layout)
+		HASH_SetIntKey(layout, offsetof(PRISONER, idNum));
+	for (i = 0; i < count && success; i++)
+		success = !HASH_Insert(layout, byId[i]);
+	if (!success) {
+		if (layout)
+			HASH_Destroy(layout, NULL);
+		free(slots);
+		free(body);
+		free(byId);
+		return 0;
+	}
+	HASH_GetSlots(layout, slots);
+	HASH_Destroy(layout, NULL);
+	rec = (SNAP_RECORD*)(body + header.recordsOff - sizeof(SNAP_HEADER));
+	nameOrder = (uint32_t*)(body + header.nameOrderOff - sizeof(SNAP_HEADER));
+	hash = (uint32_t*)(body + header.hashOff - sizeof(SNAP_HEADER));
+	strings = body + header.stringsOff - sizeof(SNAP_HEADER);
+
+	for (i = 0, stringsSize = 0; i < count; i++) {
+		prisoner = byId[i];
+		memcpy(rec[i].id, prisoner->id, sizeof(rec[i].id));
+		memcpy(rec[i].cell, prisoner->cell, sizeof(rec[i].cell));
+		rec[i].cellBlock = prisoner->cellBlock;
+		rec[i].idNum = prisoner->idNum;
+		rec[i].crime = prisoner->crime;
+		rec[i].admitDate = (int64_t)prisoner->admitDate;
+		rec[i].projReleaseDate = (int64_t)prisoner->projReleaseDate;
+		rec[i].lName = (uint32_t)stringsSize;
+		strcpy(strings + stringsSize, prisoner->lName);
+		stringsSize += strlen(prisoner->lName) + 1;
+		rec[i].fName = (uint32_t)stringsSize;
+		strcpy(strings + stringsSize, prisoner->fName);
+		stringsSize += strlen(prisoner->fName) + 1;
+	}
+	for (pos = 0; pos < header.hashSize; pos++)
+		if (slots[pos])
+			hash[pos] = snapIndex(byId, count, ((PRISONER*)slots[pos])->idNum) + 1;
+	free(slots);
+	for (i = 0, prisoner = IterBegin(nameTree, &iter); prisoner && i < count; prisoner = IterNext(&iter))
+		nameOrder[i++] = snapIndex(byId, count, prisoner->idNum);
+	header.checksum = snapChecksum(body, size);
+
+	tempName = xMalloc(strlen(fileName) + sizeof(".tmp"));
+	sprintf(tempName, "%s.tmp", fileName);
+	success = 0;
+	if ((fp = fopen(tempName, "wb"))) {
+		success = fwrite(&header, sizeof(header), 1, fp) == 1
+		          && fwrite(body, 1, size, fp) == size
+		          && !fflush(fp) && !fsync(fileno(fp));
+		success = !fclose(fp) && success;
+		if (success)
+			success = !rename(tempName, fileName);
+		if (!success)
+			remove(tempName);
+	}
+	free(tempName);
+	free(body);
+	free(byId);
+	return success;
+}
+
+/* ============== openSnapshot ================
+ * Maps a snapshot read-only and checks its header, checksum, offsets and
+ * indexes.
+ * Pre: fileName names a snapshot (see isSnapshot)
+ * Post: return the mapped snapshot, or NULL (with a message) if the file
+ *       can't be mapped or fails any check
+ */
+SNAPSHOT* openSnapshot(const char* fileName)
+{
+	SNAPSHOT* snap;
+	struct stat st;
+	int fd;
+
+	if ((fd = open(fileName, O_RDONLY)) < 0) {
+		printf("\nCan't open snapshot %s\n", fileName);
+		return NULL;
+	}
+	if (fstat(fd, &st) || (uint64_t)st.st_size < sizeof(SNAP_HEADER)) {
+		printf("\nSnapshot %s is truncated\n", fileName);
+		close(fd);
+		return NULL;
+	}
+	snap = xMalloc(sizeof(SNAPSHOT));
+	snap->size = (size_t)st.st_size;
+	snap->map = mmap(NULL, snap->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (snap->map == MAP_FAILED) {
+		printf("\nCan't map snapshot %s\n", fileName);
+		free(snap);
+		return NULL;
+	}
+	snap->header = (const SNAP_HEADER*)snap->map;
+	snap->records = (const SNAP_RECORD*)((const char*)snap->map + snap->header->recordsOff);
+	snap->nameOrder = (const uint32_t*)((const char*)snap->map + snap->header->nameOrderOff);
+	snap->hash = (const uint32_t*)((const char*)snap->map + snap->header->hashOff);
+	snap->strings = (const char*)snap->map + snap->header->stringsOff;
+	if (!snapCheck(snap)) {
+		printf("\nSnapshot %s is damaged or from another version\n", fileName);
+		closeSnapshot(snap);
+		return NULL;
+	}
+	return snap;
+}
+
+/* ============== closeSnapshot ================
+ * Pre: snap returned by openSnapshot (may be NULL)
+ * Post: unmapped and freed; records returned by the lookups are gone
+ */
+void closeSnapshot(SNAPSHOT* snap)
+{
+	if (snap) {
+		munmap(snap->map, snap->size);
+		free(snap);
+	}
+}
+
+/* ============== snapPrisoner ================
+ * Pre: rec is one of snap's records
+ * Post: return a newly allocated PRISONER holding the record, to be
+ *       freed with freePrisoner
+ */
+PRISONER* snapPrisoner(const SNAPSHOT* snap, const SNAP_RECORD* rec)
+{
+	PRISONER* prisoner = xMalloc(sizeof(PRISONER));
+
+	memcpy(prisoner->id, rec->id, sizeof(prisoner->id));
+	memcpy(prisoner->cell, rec->cell, sizeof(prisoner->cell));
+	prisoner->cellBlock = rec->cellBlock;
+	prisoner->idNum = rec->idNum;
+	prisoner->crime = (crime_t)rec->crime;
+	prisoner->admitDate = (time_t)rec->admitDate;
+	prisoner->projReleaseDate = (time_t)rec->projReleaseDate;
+	prisoner->lName = makeString(snap->strings + rec->lName);
+	prisoner->fName = makeString(snap->strings + rec->fName);
+	return prisoner;
+}
+
+/* ============== loadSnapshot ================
+ * Fills empty indexes from a snapshot. The records are already in id order,
+ * the name order is stored and so is the hash's layout, so all three are
+ * built in O(n) without sorting or probing.
+ * Pre: snap open; hash created empty with HASH_OPEN, getHashKey and
+ *      snap->header->hashSize slots; both trees created and empty
+ * Post: return 1 on success, 0 if the hash wouldn't take the stored layout
+ *       (the hash is left empty and no record is kept)
+ */
+int loadSnapshot(const SNAPSHOT* snap, HASH* hash, TREE* nameTree, TREE* idTree)
+{
+	uint32_t count = snap->header->count, i;
+	PRISONER **byId, **byName;
+	void** slots;
+	int success;
+
+	byId = xMalloc((count + 1) * sizeof(PRISONER*));
+	byName = xMalloc((count + 1) * sizeof(PRISONER*));
+	slots = xMalloc(snap->header->hashSize * sizeof(void*));
+	for (i = 0; i < count; i++)
+		byId[i] = snapPrisoner(snap, &snap->records[i]);
+	for (i = 0; i < snap->header->hashSize; i++)
+		slots[i] = snap->hash[i] ? byId[snap->hash[i] - 1] : NULL;
+	success = HASH_SetSlots(hash, slots);
+	free(slots);
+	if (!success) {
+		for (i = 0; i < count; i++)
+			freePrisoner(byId[i]);
+		free(byName);
+		free(byId);
+		return 0;
+	}
+	for (i = 0; i < count; i++)
+		byName[i] = byId[snap->nameOrder[i]];
+	success = BuildTreeSorted(idTree, (void**)byId, count)
+	          && BuildTreeSorted(nameTree, (void**)byName, count);
+	free(byName);
+	free(byId);
+	return success;
+}
+
+/* ============== snapChecksum ================
+ * Pre: body points to size bytes
+ * Post: return the checksum stored in the header
+ */
+static uint64_t snapChecksum(const void* body, uint64_t size)
+{
+	return hashBytes(body, (size_t)size, 0);
+}
+
+/* ============== snapIndex ================
+ * id's are unique, so a record's index is found by binary search on idNum.
+ * Pre: byId holds count records in ascending idNum, one of them idNum's
+ * Post: return its index
+ */
+static uint32_t snapIndex(PRISONER** byId, uint32_t count, int idNum)
+{
+	uint32_t lo = 0, hi = count, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (byId[mid]->idNum < idNum)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/* ============== snapHome ================
+ * getHashKey only reads the id, so a PRISONER holding just that will do.
+ * Pre: index is a record index of snap
+ * Post: return the record's home slot in the stored hash, as the open
+ *       addressing engine works it out
+ */
+static uint32_t snapHome(const SNAPSHOT* snap, uint32_t index)
+{
+	PRISONER key;
+
+	memset(&key, 0, sizeof(key));
+	memcpy(key.id, snap->records[index].id, sizeof(key.id));
+	key.id[sizeof(key.id) - 1] = '\0';
+	return (uint32_t)getHashKey(&key, INT_MAX) % snap->header->hashSize;
+}
+
+/* ============== snapCheck ================
+ * Pre: snap mapped, at least a header long
+ * Post: return 1 if the header matches this build, the sections lie inside
+ *       the file, the checksum matches, every name offset lands in the
+ *       string section, ids ascend, every index is in range, nameOrder and
+ *       the hash each hold every record index exactly once, and a probe
+ *       from each record's home slot meets no empty slot before the record
+ */
+static int snapCheck(const SNAPSHOT* snap)
+{
+	const SNAP_HEADER* h = snap->header;
+	uint64_t count = h->count, used = 0;
+	uint32_t i, pos;
+	unsigned char* seen;
+	int success = 1;
+
+	if (memcmp(h->magic, SNAP_MAGIC, sizeof(h->magic)) || h->version != SNAP_VERSION
+	    || h->byteOrder != SNAP_BYTE_ORDER || h->fileSize != snap->size || !h->hashSize
+	    || h->hashSize <= count)
+		return 0;
+	if (h->recordsOff < sizeof(SNAP_HEADER) || h->recordsOff % 8 || h->nameOrderOff % 8
+	    || h->hashOff % 8 || h->stringsOff % 8
+	    || h->recordsOff + count * sizeof(SNAP_RECORD) > h->nameOrderOff
+	    || h->nameOrderOff + count * sizeof(uint32_t) > h->hashOff
+	    || h->hashOff + (uint64_t)h->hashSize * sizeof(uint32_t) > h->stringsOff
+	    || h->stringsOff + h->stringsSize != h->fileSize)
+		return 0;
+	if (snapChecksum((const char*)snap->map + sizeof(SNAP_HEADER), h->fileSize - sizeof(SNAP_HEADER))
+	    != h->checksum)
+		return 0;
+	// the last string ends the section, so every name offset below it is terminated
+	if (count && (!h->stringsSize || snap->strings[h->stringsSize - 1]))
+		return 0;
+	// nameOrder must be a permutation, or a record would go into the name tree twice
+	seen = calloc(count / 8 + 1, 1);
+	if (!seen)
+		return 0;
+	for (i = 0; i < count && success; i++) {
+		if (snap->records[i].lName >= h->stringsSize || snap->records[i].fName >= h->stringsSize
+		    || (i && snap->records[i - 1].idNum >= snap->records[i].idNum)
+		    || snap->nameOrder[i] >= count
+		    || seen[snap->nameOrder[i] / 8] & (1 << snap->nameOrder[i] % 8))
+			success = 0;
+		else
+			seen[snap->nameOrder[i] / 8] |= 1 << snap->nameOrder[i] % 8;
+	}
+	// so must the hash, which then has hashSize - count > 0 empty slots
+	memset(seen, 0, count / 8 + 1);
+	for (i = 0; i < h->hashSize && success; i++) {
+		if (!snap->hash[i])
+			continue;
+		pos = snap->hash[i] - 1;
+		if (pos >= count || seen[pos / 8] & (1 << pos % 8))
+			success = 0;
+		else
+			seen[pos / 8] |= 1 << pos % 8, used++;
+	}
+	free(seen);
+	if (!success || used != count)
+		return 0;
+	for (i = 0; i < h->hashSize; i++) {
+		if (!snap->hash[i])
+			continue;
+		for (pos = snapHome(snap, snap->hash[i] - 1); pos != i && snap->hash[pos]; pos = (pos + 1) % h->hashSize)
+			;
+		if (pos != i)
+			return 0;
+	}
+	return 1;
+}
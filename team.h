@@ -1,9 +1,12 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include <time.h>
 #include <ctype.h>
 #include <stdarg.h>
+#include <pthread.h>
+#include <stdint.h>
 #include "hashADT.h"
 #include "AVL_ADT.h"
 
@@ -15,6 +18,7 @@ typedef enum	{ARSON, ASSAULT, DUI, FRAUD, KIDNAPPING,
 
 typedef struct{
 	char id[6];
+	int idNum;						// id parsed once; the key compareId uses
 	char *fName;
 	char *lName;
 	crime_t crime;
@@ -24,6 +28,109 @@ typedef struct{
 	char cell[4];
 }PRISONER;
 
+// write-ahead journal of adds and deletes (journal.c). Entries are
+// JOURNAL_ENTRY, then a SNAP_RECORD, then for an add the two names.
+typedef struct{
+	char magic[8];
+	uint32_t version;
+	uint32_t byteOrder;
+}JOURNAL_HEADER;
+
+typedef struct{
+	uint32_t type;
+	uint32_t size;			// whole entry, a multiple of 8
+	uint64_t checksum;		// hashBytes of the rest of the entry, seeded with type
+}JOURNAL_ENTRY;
+
+typedef struct{
+	int fd;
+	char* name;
+	char* snapName;			// where compaction saves the database
+	char* base;				// what setup loads: snapName if it exists, else the input
+	char* buffer;			// appended entries not yet written
+	size_t used;
+	unsigned long long appended;
+	unsigned long long durable;	// entries known to be on disk
+	unsigned long long dropped;	// entries lost to a failed write since the last compaction
+	long long entries;		// in the journal since the last compaction
+	int syncing;			// a journalSync is writing and syncing
+	pthread_mutex_t lock;
+	pthread_cond_t synced;
+}JOURNAL;
+
+// the three indexes over the same records, shared by the menu and any
+// query or intake threads. Readers hold lock for reading while they search
+// and use what they find; every insert, delete or rehash holds it for writing.
+// Name searches instead read the published snapshot of nameTree, lock-free.
+typedef struct{
+	HASH* hash;
+	TREE* nameTree;
+	TREE* idTree;
+	pthread_rwlock_t lock;
+	PUBLISHED_TREE* names;
+	JOURNAL* journal;		// NULL if changes aren't journaled
+}PRISON_DB;
+
+
+// binary snapshot file (snapshot.c). Only links by offset or index, so the
+// mapped file is used where it lies. Bump SNAP_VERSION whenever a layout changes.
+#define SNAP_MAGIC		"PRISNAP"		// 8 bytes with its NUL
+#define SNAP_VERSION	2
+#define SNAP_BYTE_ORDER	0x01020304u		// reads differently on a machine of the other byte order
+
+typedef struct{
+	char magic[8];
+	uint32_t version;
+	uint32_t byteOrder;
+	uint64_t fileSize;
+	uint64_t checksum;		// hashBytes of everything after the header, seed 0
+	uint32_t count;
+	uint32_t hashSize;
+	uint64_t recordsOff;	// SNAP_RECORD[count], ascending idNum
+	uint64_t nameOrderOff;	// uint32_t[count], record indexes in name order
+	uint64_t hashOff;		// uint32_t[hashSize], the id hash's slots: record index + 1 or 0
+	uint64_t stringsOff;
+	uint64_t stringsSize;
+}SNAP_HEADER;
+
+typedef struct{
+	int64_t admitDate;
+	int64_t projReleaseDate;
+	int32_t idNum;
+	int32_t crime;
+	uint32_t lName;			// offsets into the string section
+	uint32_t fName;
+	char id[6];
+	char cellBlock;
+	char cell[4];
+	char pad[5];
+}SNAP_RECORD;
+
+typedef struct{
+	void* map;
+	size_t size;
+	const SNAP_HEADER* header;
+	const SNAP_RECORD* records;
+	const uint32_t* nameOrder;
+	const uint32_t* hash;
+	const char* strings;
+}SNAPSHOT;
+
+// a text input file being read by nextPrisoner (parser.c)
+typedef struct{
+	const char* map;
+	const char* end;
+	const char* first;				// where this part of the file starts
+	const char* pos;				// start of the next line
+	const char* released;			// pages before this are already handed back
+	const char* block;				// 16 bytes whose delimiters are in mask
+	unsigned int mask;
+	size_t size;
+	long long line;
+	long long records;
+	struct timespec started;
+	const void* whole;				// the INPUT this one is a part of, or NULL
+}INPUT;
 
 #define MAX_NAME 20
 #define TEMP_STR 256
@@ -34,34 +141,54 @@ void setup(HASH** hash, TREE** nameTree, TREE** idTree, char* inFile);
 
 
 int getMenuChoice(int n, ...);
-int getNumLinesInFile(FILE* fp);
-void readFile(HASH** hash, TREE* nameTree, TREE* idTree, char* inFile);
+void readFile(PRISON_DB* db, char* inFile);
 int strlcmp(const char *str1, const char * str2);
 int myGets(FILE* fp, char str[], int maxSize);
 crime_t getCrime(void);
 char* makeString(const char str[]);
 const char* crimeToString(crime_t crime);
 int getMainMenuChoice(void);
-void searchManager(HASH* hash, TREE* nameTree);
+void searchManager(PRISON_DB* db);
 int getSearchMenuChoice(void);
-void deleteManager(HASH* hash, TREE* nameTree, TREE* idTree);
+void deleteManager(PRISON_DB* db);
 int addPrisoner(HASH* hash, TREE* nameTree, TREE* idTree, PRISONER* prisoner);
-void addManager(HASH** hash, TREE* nameTree, TREE* idTree);
+int addPrisonerLocked(PRISON_DB* db, PRISONER* prisoner);
+void addBatchLocked(PRISONER** records, long long* offsets, int count, void* db);
+int deletePrisonerLocked(PRISON_DB* db, PRISONER* key);
+void publishNames(PRISON_DB* db);
+void initShared(PRISON_DB* db);
+int findById(PRISON_DB* db, PRISONER* key, void (*process)(void* record));
+int findByName(PRISON_DB* db, PRISONER* key, void (*process)(void* record));
+int forEachName(FROZEN_TREE* names, PRISONER* key, void (*process)(void* record));
+void addManager(PRISON_DB* db);
 char* getPrisonerID();
+void setPrisonerID(PRISONER* prisoner, const char* id);
 int getCellNum(void);
 char getCellBlock(void);
 char* getName(char* nameDesc, int caseSensitive);
 void printWelcome(void);
 time_t getSentence(void);
 PRISONER* createPrisoner(char* string);
+INPUT* openInput(const char* fileName);
+void closeInput(INPUT* in);
+int inputEstimate(INPUT* in);
+PRISONER* nextPrisoner(INPUT* in);
+double inputRate(INPUT* in);
+void splitInput(INPUT* in, INPUT** parts, int n);
+void ingestFile(INPUT* in, void (*consume)(PRISONER** records, long long* offsets, int count, void* arg),
+		void* arg, int ordered);
+int ingestIndexes(INPUT* in, HASH** hash, TREE* nameTree, TREE* idTree);
 int yesNo(char *prompt);
 /// functions passable to ADT
 void printPrisoner(void* record);
 int compareId(void* arg1, void* arg2);
 void freePrisoner(void *record);
 int compareName(void* arg1, void* arg2);
+unsigned long long namePrefix(void* record);
 void printPrisonerBrief(void* record);
-int deleteConfirm(void* data);
+void printFound(void* record);
+int sortCompareId(const void* arg1, const void* arg2);
+int sortCompareName(const void* arg1, const void* arg2);
 
 //wrappers
 //
@@ -69,10 +196,34 @@ void *xMalloc(size_t size);
 /*************Tin_Testing_Function***********/
 void printIndex (void *index);
 void writeFile(FILE *fpOut, void *dataPtr);
+int formatRecord(char *buf, int size, void *dataPtr);
+void saveRecords(HASH *pHash, char *fileName);
 void printEfficiency(HASH *pHash);
 
+/*************** journal **********************/
+JOURNAL* createJournal(const char* inFile);
+long long replayJournal(JOURNAL* journal, HASH** hash, TREE* nameTree, TREE* idTree);
+void journalAdd(JOURNAL* journal, const PRISONER* prisoner);
+void journalDelete(JOURNAL* journal, const PRISONER* prisoner);
+int journalSync(JOURNAL* journal);
+int journalDue(JOURNAL* journal);
+int compactJournal(PRISON_DB* db);
+JOURNAL* closeJournal(JOURNAL* journal);
+
+/*************** snapshots **********************/
+int isSnapshot(const char* fileName);
+int saveSnapshot(TREE* idTree, TREE* nameTree, const char* fileName);
+SNAPSHOT* openSnapshot(const char* fileName);
+void closeSnapshot(SNAPSHOT* snap);
+PRISONER* snapPrisoner(const SNAPSHOT* snap, const SNAP_RECORD* rec);
+int loadSnapshot(const SNAPSHOT* snap, HASH* hash, TREE* nameTree, TREE* idTree);
+
 /*************** Brenda **********************/
 
 void cleanUp(HASH** hash, TREE** nameTree, TREE** idTree);
 int getHashKey(void *record, int hashSize); 
 int getPrime(int x);
+int isPrime(unsigned long long n);
+unsigned long long nextPrime(unsigned long long n);
+void setHashSeed(unsigned long long seed);
+unsigned long long hashBytes(const void* key, size_t len, unsigned long long seed);
@@ -1,5 +1,12 @@
+#include <unistd.h>
 #include "team.h"
 
+#define PARALLEL_SAVE_MIN  100000   // fewer records than this are saved by one thread
+#define SAVE_THREADS_MAX   8
+
+static char *putNumber(char *out, long long n);
+static char *putString(char *out, const char *str);
+
 
 /***TIn_Testing_F/unction_Definitions**/
 /***
@@ -28,19 +35,123 @@ void writeFile(FILE *fpOut, void *dataPtr)
                                             (long long)scoopyDoo->admitDate,
                                             (long long)scoopyDoo->projReleaseDate,
                                             scoopyDoo->cellBlock, scoopyDoo->cell);
-    printf("Successfully 1 record to file!\n");
 //	return 1;
 }
 /***
-    This function
+    Formats a record the way writeFile prints it, for HASH_SaveFileBuffered.
+    The numbers are converted by hand instead of through printf.
+    pre: buf has room for size bytes
+    post: returns the length written (no NUL), or, if the record might not
+          fit in size bytes, the room it needs (and nothing is written)
+*/
+int formatRecord(char *buf, int size, void *dataPtr)
+{
+    PRISONER *scoopyDoo = (PRISONER *)dataPtr;
+    char *out = buf;
+    int need;
+
+    // each number takes at most 20 characters; 7 separators and a newline
+    need = strlen(scoopyDoo->id) + strlen(scoopyDoo->lName) + strlen(scoopyDoo->fName)
+         + strlen(scoopyDoo->cell) + 3 * 20 + 1 + 8;
+    if(need > size)
+        return need;
+    out = putString(out, scoopyDoo->id);
+    *out++ = ';';
+    out = putString(out, scoopyDoo->lName);
+    *out++ = ',';
+    out = putString(out, scoopyDoo->fName);
+    *out++ = ';';
+    out = putNumber(out, scoopyDoo->crime);
+    *out++ = ';';
+    out = putNumber(out, (long long)scoopyDoo->admitDate);
+    *out++ = ';';
+    out = putNumber(out, (long long)scoopyDoo->projReleaseDate);
+    *out++ = ';';
+    *out++ = scoopyDoo->cellBlock;
+    *out++ = ';';
+    out = putString(out, scoopyDoo->cell);
+    *out++ = '\n';
+    return (int)(out - buf);
+}
+/***
+    Saves every record in the hash table to fileName with
+    HASH_SaveFileBuffered (in parallel for large tables) and reports
+    how long it took.
+    pre: table not changing meanwhile
+    post: file written, or an error reported
+*/
+void saveRecords(HASH *pHash, char *fileName)
+{
+    struct timespec start, end;
+    double seconds;
+    long long bytes;
+    int threads = 1;
+
+    if(HASH_Count(pHash) >= PARALLEL_SAVE_MIN){
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+        if(threads > SAVE_THREADS_MAX)
+            threads = SAVE_THREADS_MAX;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    bytes = HASH_SaveFileBuffered(pHash, fileName, formatRecord, threads);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if(bytes < 0){
+        printf("\nCouldn't save records to %s\n", fileName);
+        return;
+    }
+    seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("\nSaved %d records (%lld bytes) in %.3f s", HASH_Count(pHash), bytes, seconds);
+    if(seconds > 0)
+        printf(" (%.1f MB/s)", bytes / seconds / 1e6);
+    printf("\n");
+    return;
+}
+/***
+    pre: out has room for the number
+    post: n written in decimal; returns the position after it
+*/
+static char *putNumber(char *out, long long n)
+{
+    char digits[20];
+    unsigned long long u = n < 0 ? 0ULL - (unsigned long long)n : (unsigned long long)n;
+    int i = 0;
+
+    if(n < 0)
+        *out++ = '-';
+    do{
+        digits[i++] = (char)('0' + u % 10);
+        u /= 10;
+    }while(u);
+    while(i)
+        *out++ = digits[--i];
+    return out;
+}
+/***
+    pre: out has room for str
+    post: str copied without its NUL; returns the position after it
+*/
+static char *putString(char *out, const char *str)
+{
+    while(*str)
+        *out++ = *str++;
+    return out;
+}
+/***
+    This function prints the table statistics and how many buckets hold
+    lists of each length (probe lengths for an open-addressing table).
     pre:
     post:
 */
 void printEfficiency(HASH *pHash)
 {
+    int length;
+
     printf("\nLongest List: %d", HASH_GetLongestList(pHash));
     printf("\nTotal records: %d", HASH_Count(pHash));
     printf("\nHash loads:    %.2f%%\n", HASH_Load(pHash));
+    printf("\nList length   Buckets\n");
+    for(length = 0; length <= HASH_GetLongestList(pHash); length++)
+        printf("%11d   %d\n", length, HASH_ChainCount(pHash, length));
 
     return;
 }